@@ -0,0 +1,171 @@
+#ifndef _ACCSUM_HPP_
+#define _ACCSUM_HPP_
+
+#include <cmath>
+#include <limits>
+#include <memory>
+
+#include "accurate_math.hpp"
+#include "kulisch.hpp"
+#include "simd.hpp"
+
+/* AccSum and AccDot of Rump, Ogita and Oishi, "Accurate
+ * Floating-Point Summation Part I: Faithful Rounding".
+ *
+ * AccSum repeatedly splits each summand p[i] against a
+ * power of two sigma into a high part q[i], whose sum is
+ * exact in any order, and a remainder left in p[i]. Once
+ * the high parts add up to something large enough next
+ * to sigma, the remainders can only change the last bit,
+ * so summing them naively gives a faithfully rounded
+ * result. Each pass lowers sigma by about
+ * log2(1 / u) - log2(n) bits, so well conditioned sums
+ * take two or three passes over the data and harder ones
+ * more.
+ *
+ * AccDot is AccSum of the 2 * len products and product
+ * errors from twoProd.
+ * n + 2 may be at most 2^(digits / 2), so 2^26 - 2
+ * summands for double, and n * max |p[i]| must not
+ * overflow. Longer sums, and those too close to overflow,
+ * are left to a KulischAccumulator.
+ *
+ * FastAccSum, from Rump's "Ultimately Fast Accurate
+ * Summation", saves a pass by carrying sigma from term to
+ * term, but that makes each extraction depend on the
+ * last, so it can't be vectorized like ExtractVector.
+ */
+
+/* Whether AccSum is faithful for n summands */
+template <typename fptype>
+bool accSumFits(unsigned long long n) {
+  return n + 2 <=
+         1ull << (std::numeric_limits<fptype>::digits / 2);
+}
+
+/* The smallest power of two no less than |x| */
+template <typename fptype>
+fptype nextPowerTwo(fptype x) {
+  int e;
+  fptype m = std::frexp(std::fabs(x), &e);
+  return m == fptype(0.5) ? std::fabs(x)
+                          : std::ldexp(fptype(1.0), e);
+}
+
+template <typename fptype,
+          unsigned lanes = simdWidest<fptype>::width>
+fptype maxAbsVector(const fptype *p, unsigned n) {
+  typedef simd<fptype, lanes> vec;
+  vec m(0.0);
+  unsigned i = 0;
+  for(; i + lanes <= n; i += lanes)
+    m = max(fabs(vec::load(p + i)), m);
+  fptype ret = m.reduceMax();
+  for(; i < n; i++) {
+    fptype x = std::fabs(p[i]);
+    ret = x > ret ? x : ret;
+  }
+  return ret;
+}
+
+template <typename fptype,
+          unsigned lanes = simdWidest<fptype>::width>
+fptype sumVector(const fptype *p, unsigned n) {
+  typedef simd<fptype, lanes> vec;
+  vec total(0.0);
+  unsigned i = 0;
+  for(; i + lanes <= n; i += lanes) total += vec::load(p + i);
+  fptype ret = total.reduceAdd();
+  for(; i < n; i++) ret += p[i];
+  return ret;
+}
+
+/* Replaces each p[i] with its part below the ulp of
+ * sigma, returning the exact sum of the parts above */
+template <typename fptype,
+          unsigned lanes = simdWidest<fptype>::width>
+fptype extractVector(fptype sigma, fptype *p, unsigned n) {
+  typedef simd<fptype, lanes> vec;
+  const vec sigmaPack(sigma);
+  vec tau(0.0);
+  unsigned i = 0;
+  for(; i + lanes <= n; i += lanes) {
+    vec x = vec::load(p + i);
+    vec q = (sigmaPack + x) - sigmaPack;
+    tau += q;
+    (x - q).store(p + i);
+  }
+  fptype ret = tau.reduceAdd();
+  for(; i < n; i++) {
+    fptype q = (sigma + p[i]) - sigma;
+    ret += q;
+    p[i] -= q;
+  }
+  return ret;
+}
+
+/* The sum of p[0..n), correctly rounded */
+template <typename fptype>
+fptype kulischSum(const fptype *p, unsigned n) {
+  KulischAccumulator<fptype> total;
+  for(unsigned i = 0; i < n; i++) total.add(p[i]);
+  return total.template result<fptype>();
+}
+
+/* A faithful rounding of the sum of p[0..n), which is
+ * overwritten */
+template <typename fptype,
+          unsigned lanes = simdWidest<fptype>::width>
+fptype accSum(fptype *p, unsigned n) {
+  typedef std::numeric_limits<fptype> limits;
+  const fptype eps = std::ldexp(fptype(1.0), -limits::digits);
+  if(!accSumFits<fptype>(n)) return kulischSum(p, n);
+  /* Restarts on what is left of p when the high parts
+   * cancel completely */
+  for(;;) {
+    fptype mu = maxAbsVector<fptype, lanes>(p, n);
+    if(mu == 0.0) return 0.0;
+    if(!std::isfinite(mu))
+      return sumVector<fptype, lanes>(p, n);
+    const fptype ms = nextPowerTwo(fptype(n + 2));
+    const fptype phi = eps * ms;
+    const fptype factor = eps * ms * ms;
+    fptype sigma = ms * nextPowerTwo(mu);
+    /* Too close to overflow to split; t is 0 here, so p
+     * holds the whole sum */
+    if(!std::isfinite(sigma)) return kulischSum(p, n);
+    fptype t = 0.0;
+    for(;;) {
+      fptype tau = extractVector<fptype, lanes>(sigma, p, n);
+      fptype tau1 = t + tau;
+      if(std::fabs(tau1) >= factor * sigma ||
+         sigma <= limits::min()) {
+        fptype tau2 = tau - (tau1 - t);
+        return tau1 + (tau2 + sumVector<fptype, lanes>(p, n));
+      }
+      t = tau1;
+      if(t == 0.0) break;
+      sigma *= phi;
+    }
+  }
+}
+
+template <typename fptype,
+          unsigned lanes = simdWidest<fptype>::width>
+fptype accDotProd(const fptype *v1, const fptype *v2,
+                  unsigned len) {
+  /* 2 * len could also wrap */
+  if(!accSumFits<fptype>(2ull * len))
+    return kulischDotProd<fptype, fptype>(v1, v2, len);
+  /* Not value initialized, as twoProdBatch fills it */
+  std::unique_ptr<fptype[]> terms(new fptype[2 * len]);
+  twoProdBatch(v1, v2, terms.get(), terms.get() + len, len);
+  fptype ret = accSum<fptype, lanes>(terms.get(), 2 * len);
+  /* Products which overflowed may still have a finite sum,
+   * which the accumulator finds from the inputs */
+  if(!std::isfinite(ret))
+    return kulischDotProd<fptype, fptype>(v1, v2, len);
+  return ret;
+}
+
+#endif
@@ -5,70 +5,204 @@
 #include <array>
 #include <cmath>
 #include <limits.h>
+#include <type_traits>
 
 #include "genericfp.hpp"
+#include "simd.hpp"
 
-template <unsigned size, typename fptype>
-fptype kahanSum(const fptype(&summands)[size]) {
-  fptype ret = 0.0;
-  fptype c = 0.0;
-  for(unsigned i = 0; i < size; i++) {
-    fptype mod = summands[i] - c;
-    fptype tmp = ret + mod;
-    c = (tmp - ret) - mod;
-    ret = tmp;
-  }
-  return ret;
-}
-
+/* Knuth's TwoSum: x + y == a + b exactly, for any
+ * ordering of a and b, with no branches */
 template <typename fptype>
-fptype kahanSum(const fptype *summands, unsigned size) {
-  fptype ret = 0.0;
-  fptype c = 0.0;
-  for(unsigned i = 0; i < size; i++) {
-    fptype mod = summands[i] - c;
-    fptype tmp = ret + mod;
-    c = (tmp - ret) - mod;
-    ret = tmp;
-  }
-  return ret;
+std::array<fptype, 2> twoSum(fptype a, fptype b) {
+  fptype x = a + b;
+  fptype bVirtual = x - a;
+  fptype aVirtual = x - bVirtual;
+  fptype y = (a - aVirtual) + (b - bVirtual);
+  std::array<fptype, 2> sum = {{x, y}};
+  return sum;
 }
 
+/* Dekker's Fast2Sum; only exact when |a| >= |b|
+ * (or a == 0), but half the cost of twoSum */
 template <typename fptype>
-std::array<fptype, 2> twoSum(fptype a, fptype b) {
-  if(a < b) {
-    fptype tmp = b;
-    b = a;
-    a = tmp;
-  }
+std::array<fptype, 2> fastTwoSum(fptype a, fptype b) {
   fptype x = a + b;
-  fptype c = x - a;
-  fptype y = b - c;
+  fptype y = b - (x - a);
   std::array<fptype, 2> sum = {{x, y}};
   return sum;
 }
 
 template <typename fptype>
 std::array<fptype, 2> twoProd(fptype lhs, fptype rhs) {
+  using std::fma;
   fptype prod = lhs * rhs;
-  fptype err = std::fma(lhs, rhs, -prod);
+  fptype err = fma(lhs, rhs, -prod);
   std::array<fptype, 2> products = {{prod, err}};
   return products;
 }
 
+/* Array at a time versions of the transforms above:
+ * s[i] + e[i] == a[i] op b[i] exactly for i < n.
+ * The loops are branch free so they vectorize; the
+ * outputs must not overlap each other or the inputs.
+ */
+template <typename fptype>
+void twoSumBatch(const fptype *a, const fptype *b,
+                 fptype *__restrict__ s,
+                 fptype *__restrict__ e, unsigned n) {
+  for(unsigned i = 0; i < n; i++) {
+    std::array<fptype, 2> sum = twoSum(a[i], b[i]);
+    s[i] = sum[0];
+    e[i] = sum[1];
+  }
+}
+
+template <typename fptype>
+void fastTwoSumBatch(const fptype *a, const fptype *b,
+                     fptype *__restrict__ s,
+                     fptype *__restrict__ e, unsigned n) {
+  for(unsigned i = 0; i < n; i++) {
+    std::array<fptype, 2> sum = fastTwoSum(a[i], b[i]);
+    s[i] = sum[0];
+    e[i] = sum[1];
+  }
+}
+
+template <typename fptype>
+void twoProdBatch(const fptype *a, const fptype *b,
+                  fptype *__restrict__ p,
+                  fptype *__restrict__ e, unsigned n) {
+  for(unsigned i = 0; i < n; i++) {
+    std::array<fptype, 2> prod = twoProd(a[i], b[i]);
+    p[i] = prod[0];
+    e[i] = prod[1];
+  }
+}
+
+/* Neumaier's improvement of Kahan summation, with the
+ * magnitude test replaced by twoSum so it has no branches:
+ * the rounding error of each addition goes into c.
+ */
+template <typename fptype>
+inline void kahanStep(fptype &ret, fptype &c, fptype x) {
+  std::array<fptype, 2> sum = twoSum(ret, x);
+  ret = sum[0];
+  c += sum[1];
+}
+
+/* Compensated sum over unroll packs of lanes
+ * independent (ret, c) pairs, merged with twoSum at the
+ * end */
+template <typename fptype,
+          unsigned lanes = simdWidest<fptype>::width,
+          unsigned unroll = 2>
+fptype kahanSum(const fptype *summands, unsigned size) {
+  typedef simd<fptype, lanes> vec;
+  constexpr const unsigned block = lanes * unroll;
+  vec ret[unroll];
+  vec c[unroll];
+  for(unsigned u = 0; u < unroll; u++) {
+    ret[u] = 0.0;
+    c[u] = 0.0;
+  }
+  unsigned i = 0;
+  for(; i + block <= size; i += block) {
+    for(unsigned u = 0; u < unroll; u++)
+      kahanStep(ret[u], c[u],
+                vec::load(summands + i + u * lanes));
+  }
+  fptype sum = 0.0;
+  fptype err = 0.0;
+  for(; i < size; i++) kahanStep(sum, err, summands[i]);
+  for(unsigned u = 0; u < unroll; u++) {
+    for(unsigned j = 0; j < lanes; j++) {
+      kahanStep(sum, err, ret[u][j]);
+      err += c[u][j];
+    }
+  }
+  return sum + err;
+}
+
+/* Arrays up to this length are summed with a fully
+ * unrolled chain rather than the lane loop */
+constexpr const unsigned kahanUnrollLimit = 32;
+
+template <unsigned i, unsigned size>
+struct kahanUnrolled {
+  template <typename fptype>
+  static void sum(const fptype(&summands)[size],
+                  fptype &ret, fptype &c) {
+    kahanStep(ret, c, summands[i]);
+    kahanUnrolled<i + 1, size>::sum(summands, ret, c);
+  }
+};
+
+template <unsigned size>
+struct kahanUnrolled<size, size> {
+  template <typename fptype>
+  static void sum(const fptype(&)[size], fptype &,
+                  fptype &) {}
+};
+
+template <unsigned size, typename fptype>
+fptype kahanSum(const fptype(&summands)[size],
+                std::true_type) {
+  fptype ret = 0.0;
+  fptype c = 0.0;
+  kahanUnrolled<0, size>::sum(summands, ret, c);
+  return ret + c;
+}
+
+template <unsigned size, typename fptype>
+fptype kahanSum(const fptype(&summands)[size],
+                std::false_type) {
+  return kahanSum(summands, size);
+}
+
+template <unsigned size, typename fptype>
+fptype kahanSum(const fptype(&summands)[size]) {
+  return kahanSum(
+      summands,
+      std::integral_constant<bool, (size <=
+                                    kahanUnrollLimit)>());
+}
+
+/* Boldo and Muller's ErrFma:
+ * r1 + r2 + r3 == a * b + c exactly, with r1 = fma(a, b, c)
+ * and |r2 + r3| <= ulp(r1) / 2
+ */
 template <typename fptype>
 std::array<fptype, 3> threeFMA(fptype a, fptype b,
                                fptype c) {
-  fptype r1 = std::fma(a, b, c);
+  using std::fma;
+  fptype r1 = fma(a, b, c);
   std::array<fptype, 2> mult = twoProd(a, b);
   std::array<fptype, 2> sum1 = twoSum(c, mult[1]);
   std::array<fptype, 2> sum2 = twoSum(mult[0], sum1[0]);
   fptype gamma = (sum2[0] - r1) + sum2[1];
-  std::array<fptype, 2> sum3 = twoSum(gamma, sum1[1]);
-  std::array<fptype, 3> ret = {{r1, sum3[1], sum3[2]}};
+  std::array<fptype, 2> sum3 = fastTwoSum(gamma, sum1[1]);
+  std::array<fptype, 3> ret = {{r1, sum3[0], sum3[1]}};
   return ret;
 }
 
+/* threeFMA applied elementwise over arrays of length n.
+ * Each element is independent and branch free, so the
+ * loop vectorizes when built for an FMA capable ISA.
+ */
+template <typename fptype>
+void threeFMABatch(const fptype *a, const fptype *b,
+                   const fptype *c,
+                   fptype *__restrict__ r1,
+                   fptype *__restrict__ r2,
+                   fptype *__restrict__ r3, unsigned n) {
+  for(unsigned i = 0; i < n; i++) {
+    std::array<fptype, 3> r = threeFMA(a[i], b[i], c[i]);
+    r1[i] = r[0];
+    r2[i] = r[1];
+    r3[i] = r[2];
+  }
+}
+
 template <typename fptype>
 fptype compensatedDotProd(const fptype *vec1,
                           const fptype *vec2,
@@ -85,4 +219,136 @@ fptype compensatedDotProd(const fptype *vec1,
   return s + c;
 }
 
+/* One Dot2 step: TwoProd of a and b, then TwoSum of the
+ * product into s, with both rounding errors collected
+ * in c.
+ */
+template <typename fptype>
+inline void dot2Step(fptype &s, fptype &c, fptype a,
+                     fptype b) {
+  std::array<fptype, 2> prod = twoProd(a, b);
+  std::array<fptype, 2> sum = twoSum(s, prod[0]);
+  s = sum[0];
+  c += sum[1] + prod[1];
+}
+
+/* Dot2 with the running sum spread over unroll packs of
+ * lanes independent (s, c) pairs, so a product only waits
+ * on the sum from lanes * unroll elements ago instead of
+ * the previous one. lanes defaults to one 512 bit
+ * register of fptype, which is two AVX2 registers.
+ * The pairs are merged with TwoSum at the end, so the
+ * result keeps Dot2's error bound.
+ */
+template <typename fptype,
+          unsigned lanes = simdWidest<fptype>::width,
+          unsigned unroll = 2>
+fptype simdCompensatedDotProd(const fptype *vec1,
+                              const fptype *vec2,
+                              unsigned dim) {
+  typedef simd<fptype, lanes> vec;
+  constexpr const unsigned block = lanes * unroll;
+  vec s[unroll];
+  vec c[unroll];
+  for(unsigned u = 0; u < unroll; u++) {
+    s[u] = 0.0;
+    c[u] = 0.0;
+  }
+  unsigned i = 0;
+  for(; i + block <= dim; i += block) {
+    for(unsigned u = 0; u < unroll; u++)
+      dot2Step(s[u], c[u], vec::load(vec1 + i + u * lanes),
+               vec::load(vec2 + i + u * lanes));
+  }
+  fptype sum = 0.0;
+  fptype err = 0.0;
+  for(; i < dim; i++) dot2Step(sum, err, vec1[i], vec2[i]);
+  for(unsigned u = 0; u < unroll; u++) {
+    for(unsigned j = 0; j < lanes; j++) {
+      std::array<fptype, 2> merged = twoSum(sum, s[u][j]);
+      sum = merged[0];
+      err += merged[1] + c[u][j];
+    }
+  }
+  return sum + err;
+}
+
+/* Adds x to level first of a cascade of twoSum
+ * accumulators. Each level's rounding error goes on to the
+ * next, and the last level's is summed naively into c, so
+ * the sum of s and c is unchanged apart from that last
+ * rounding.
+ */
+template <typename fptype, unsigned levels>
+inline void cascadeAdd(fptype (&s)[levels], fptype &c,
+                       fptype x, unsigned first) {
+  for(unsigned k = first; k < levels; k++) {
+    std::array<fptype, 2> sum = twoSum(s[k], x);
+    s[k] = sum[0];
+    x = sum[1];
+  }
+  c += x;
+}
+
+/* DotK of Ogita, Rump and Oishi: the dot product as if
+ * computed in K fold working precision and then rounded,
+ * K >= 2. K = 2 is Dot2.
+ *
+ * DotK makes K - 1 error free vector transformation
+ * passes over the products and their errors. Here the
+ * passes are streamed instead: each pass is one level of
+ * a cascade holding its running sum, and an error leaves
+ * one level for the next as soon as it is produced, so no
+ * error vector is ever stored. Each product goes into the
+ * first level and its twoProd error into the second, as
+ * in DotK. Like simdCompensatedDotProd, unroll packs of
+ * lanes independent cascades are merged at the end, and
+ * finally each level's sum is passed down the cascade as
+ * the last element of its pass.
+ */
+template <typename fptype, unsigned K,
+          unsigned lanes = simdWidest<fptype>::width,
+          unsigned unroll = 2>
+fptype dotK(const fptype *vec1, const fptype *vec2,
+            unsigned dim) {
+  static_assert(K >= 2, "dotK needs K >= 2");
+  constexpr const unsigned levels = K - 1;
+  typedef simd<fptype, lanes> vec;
+  constexpr const unsigned block = lanes * unroll;
+  vec s[unroll][levels];
+  vec c[unroll];
+  for(unsigned u = 0; u < unroll; u++) {
+    for(unsigned k = 0; k < levels; k++) s[u][k] = 0.0;
+    c[u] = 0.0;
+  }
+  unsigned i = 0;
+  for(; i + block <= dim; i += block) {
+    for(unsigned u = 0; u < unroll; u++) {
+      std::array<vec, 2> prod =
+          twoProd(vec::load(vec1 + i + u * lanes),
+                  vec::load(vec2 + i + u * lanes));
+      cascadeAdd(s[u], c[u], prod[0], 0);
+      cascadeAdd(s[u], c[u], prod[1], 1);
+    }
+  }
+  fptype sum[levels];
+  for(unsigned k = 0; k < levels; k++) sum[k] = 0.0;
+  fptype err = 0.0;
+  for(; i < dim; i++) {
+    std::array<fptype, 2> prod = twoProd(vec1[i], vec2[i]);
+    cascadeAdd(sum, err, prod[0], 0);
+    cascadeAdd(sum, err, prod[1], 1);
+  }
+  for(unsigned u = 0; u < unroll; u++) {
+    for(unsigned j = 0; j < lanes; j++) {
+      for(unsigned k = 0; k < levels; k++)
+        cascadeAdd(sum, err, s[u][k][j], k);
+      err += c[u][j];
+    }
+  }
+  for(unsigned k = 0; k + 1 < levels; k++)
+    cascadeAdd(sum, err, sum[k], k + 1);
+  return sum[levels - 1] + err;
+}
+
 #endif
@@ -0,0 +1,222 @@
+#ifndef _DD_REAL_HPP_
+#define _DD_REAL_HPP_
+
+#include <array>
+
+#include "accurate_math.hpp"
+#include "simd.hpp"
+
+/* Double-double and quad-double style numbers built on
+ * twoSum and twoProd, usable as the rettype of
+ * kobbeltDotProd and as accumulators in place of
+ * long double, which is slow x87 code on x86-64 and
+ * silently just double elsewhere.
+ *
+ * The component type may be a simd pack, in which case
+ * ddReal<simd<double, 8> > holds eight independent
+ * double-doubles as a pack of hi parts and a pack of lo
+ * parts, so extended accumulation runs at FMA throughput.
+ */
+
+/* hi + lo with |lo| <= ulp(hi) / 2 */
+template <typename fptype>
+struct ddReal {
+  fptype hi, lo;
+
+  ddReal() {}
+
+  ddReal(fptype val) : hi(val), lo(0.0) {}
+
+  ddReal(fptype h, fptype l) : hi(h), lo(l) {}
+
+  /* The exact product of a and b */
+  static ddReal product(fptype a, fptype b) {
+    std::array<fptype, 2> prod = twoProd(a, b);
+    return ddReal(prod[0], prod[1]);
+  }
+
+  ddReal &operator+=(const ddReal &rhs) {
+    std::array<fptype, 2> s = twoSum(hi, rhs.hi);
+    std::array<fptype, 2> t = twoSum(lo, rhs.lo);
+    s[1] += t[0];
+    s = fastTwoSum(s[0], s[1]);
+    s[1] += t[1];
+    s = fastTwoSum(s[0], s[1]);
+    hi = s[0];
+    lo = s[1];
+    return *this;
+  }
+
+  ddReal &operator+=(fptype rhs) {
+    std::array<fptype, 2> s = twoSum(hi, rhs);
+    s[1] += lo;
+    s = fastTwoSum(s[0], s[1]);
+    hi = s[0];
+    lo = s[1];
+    return *this;
+  }
+
+  ddReal &operator-=(const ddReal &rhs) {
+    return *this += -rhs;
+  }
+
+  ddReal &operator*=(const ddReal &rhs) {
+    std::array<fptype, 2> p = twoProd(hi, rhs.hi);
+    p[1] += hi * rhs.lo + lo * rhs.hi;
+    p = fastTwoSum(p[0], p[1]);
+    hi = p[0];
+    lo = p[1];
+    return *this;
+  }
+
+  friend ddReal operator-(const ddReal &val) {
+    return ddReal(-val.hi, -val.lo);
+  }
+
+  friend ddReal operator+(ddReal lhs, const ddReal &rhs) {
+    return lhs += rhs;
+  }
+
+  friend ddReal operator-(ddReal lhs, const ddReal &rhs) {
+    return lhs -= rhs;
+  }
+
+  friend ddReal operator*(ddReal lhs, const ddReal &rhs) {
+    return lhs *= rhs;
+  }
+
+  explicit operator fptype() const { return hi + lo; }
+};
+
+/* x[0] + x[1] + x[2] + x[3], largest first.
+ * Additions cascade the new term down through the
+ * components with twoSum and renormalize without the
+ * zero tests of the QD library, so the carries are branch
+ * free at the cost of slightly weaker normalization.
+ */
+template <typename fptype>
+struct qdReal {
+  fptype x[4];
+
+  qdReal() {}
+
+  qdReal(fptype val) {
+    x[0] = val;
+    x[1] = x[2] = x[3] = 0.0;
+  }
+
+  qdReal(const ddReal<fptype> &val) {
+    x[0] = val.hi;
+    x[1] = val.lo;
+    x[2] = x[3] = 0.0;
+  }
+
+  /* The exact product of a and b */
+  static qdReal product(fptype a, fptype b) {
+    return qdReal(ddReal<fptype>::product(a, b));
+  }
+
+  qdReal &operator+=(fptype rhs) {
+    fptype c[5];
+    fptype carry = rhs;
+    for(unsigned i = 0; i < 4; i++) {
+      std::array<fptype, 2> s = twoSum(x[i], carry);
+      c[i] = s[0];
+      carry = s[1];
+    }
+    c[4] = carry;
+    renormalize(c);
+    return *this;
+  }
+
+  qdReal &operator+=(const qdReal &rhs) {
+    for(unsigned i = 0; i < 4; i++) *this += rhs.x[i];
+    return *this;
+  }
+
+  friend qdReal operator-(const qdReal &val) {
+    qdReal ret;
+    for(unsigned i = 0; i < 4; i++) ret.x[i] = -val.x[i];
+    return ret;
+  }
+
+  friend qdReal operator+(qdReal lhs, const qdReal &rhs) {
+    return lhs += rhs;
+  }
+
+  explicit operator fptype() const {
+    return x[0] + (x[1] + (x[2] + x[3]));
+  }
+
+  explicit operator ddReal<fptype>() const {
+    ddReal<fptype> ret(x[0], x[1]);
+    ret += x[2] + x[3];
+    return ret;
+  }
+
+ private:
+  /* Squeezes the five components of c into x, rounding
+   * only the final, smallest one */
+  void renormalize(fptype(&c)[5]) {
+    /* Bottom up, so c[0] picks up the rounded tail */
+    fptype sum = c[4];
+    for(int i = 3; i >= 0; i--) {
+      std::array<fptype, 2> s = twoSum(c[i], sum);
+      sum = s[0];
+      c[i + 1] = s[1];
+    }
+    c[0] = sum;
+    /* Top down, so each component's error goes on to
+     * the next */
+    fptype carry = c[0];
+    for(unsigned i = 0; i < 3; i++) {
+      std::array<fptype, 2> s = twoSum(carry, c[i + 1]);
+      x[i] = s[0];
+      carry = s[1];
+    }
+    x[3] = carry + c[4];
+  }
+};
+
+/* Dot product accumulated in acctype, e.g. ddReal<double>
+ * or qdReal<double>, from the exact products */
+template <typename fptype, typename acctype>
+acctype extendedDotProd(const fptype *v1, const fptype *v2,
+                        unsigned len) {
+  acctype total = 0.0;
+  for(unsigned i = 0; i < len; i++)
+    total += acctype::product(v1[i], v2[i]);
+  return total;
+}
+
+/* extendedDotProd into double-doubles, with unroll packs
+ * of lanes independent accumulators */
+template <typename fptype,
+          unsigned lanes = simdWidest<fptype>::width,
+          unsigned unroll = 2>
+ddReal<fptype> simdDDDotProd(const fptype *v1,
+                             const fptype *v2,
+                             unsigned len) {
+  typedef simd<fptype, lanes> vec;
+  constexpr const unsigned block = lanes * unroll;
+  ddReal<vec> total[unroll];
+  for(unsigned u = 0; u < unroll; u++)
+    total[u] = ddReal<vec>(vec(0.0));
+  unsigned i = 0;
+  for(; i + block <= len; i += block) {
+    for(unsigned u = 0; u < unroll; u++)
+      total[u] += ddReal<vec>::product(
+          vec::load(v1 + i + u * lanes),
+          vec::load(v2 + i + u * lanes));
+  }
+  ddReal<fptype> ret = 0.0;
+  for(; i < len; i++)
+    ret += ddReal<fptype>::product(v1[i], v2[i]);
+  for(unsigned u = 0; u < unroll; u++) {
+    for(unsigned j = 0; j < lanes; j++)
+      ret += ddReal<fptype>(total[u].hi[j], total[u].lo[j]);
+  }
+  return ret;
+}
+
+#endif
@@ -0,0 +1,156 @@
+#ifndef _DISPATCH_HPP_
+#define _DISPATCH_HPP_
+
+/* Runtime selection between builds of the same kernel for
+ * baseline x86-64, AVX2+FMA and AVX-512.
+ * Each ISA gets a wrapper compiled with the matching
+ * target attribute and flattened, so the whole kernel
+ * (std::fma included) is inlined into it and code
+ * generated for that ISA, while the rest of the binary
+ * stays baseline. The CPU is probed once, on first use.
+ */
+
+#if defined(__GNUC__) && \
+    (defined(__x86_64__) || defined(__i386__))
+#define DISPATCH_X86 1
+#endif
+
+enum cpuLevel { cpuBaseline, cpuAVX2, cpuAVX512 };
+
+inline cpuLevel detectCPULevel() {
+#ifdef DISPATCH_X86
+  __builtin_cpu_init();
+  bool avx2 = __builtin_cpu_supports("avx2") &&
+              __builtin_cpu_supports("fma");
+  if(avx2 && __builtin_cpu_supports("avx512f") &&
+     __builtin_cpu_supports("avx512dq"))
+    return cpuAVX512;
+  if(avx2) return cpuAVX2;
+#endif
+  return cpuBaseline;
+}
+
+inline cpuLevel cpuFeatures() {
+  static const cpuLevel level = detectCPULevel();
+  return level;
+}
+
+inline const char *cpuLevelName(cpuLevel level) {
+  switch(level) {
+    case cpuAVX512:
+      return "AVX-512";
+    case cpuAVX2:
+      return "AVX2+FMA";
+    default:
+      return "x86-64";
+  }
+}
+
+#ifdef DISPATCH_X86
+
+template <typename fptype, typename rettype,
+          rettype (*dp)(const fptype *, const fptype *,
+                        unsigned)>
+__attribute__((flatten)) rettype baselineKernel(
+    const fptype *v1, const fptype *v2, unsigned len) {
+  return dp(v1, v2, len);
+}
+
+template <typename fptype, typename rettype,
+          rettype (*dp)(const fptype *, const fptype *,
+                        unsigned)>
+__attribute__((target("avx2,fma"), flatten)) rettype
+avx2Kernel(const fptype *v1, const fptype *v2,
+           unsigned len) {
+  return dp(v1, v2, len);
+}
+
+template <typename fptype, typename rettype,
+          rettype (*dp)(const fptype *, const fptype *,
+                        unsigned)>
+__attribute__((target("avx512f,avx512dq,avx2,fma,"
+                      "prefer-vector-width=512"),
+               flatten)) rettype
+avx512Kernel(const fptype *v1, const fptype *v2,
+             unsigned len) {
+  return dp(v1, v2, len);
+}
+
+/* The same for batch kernels, which compute the dot
+ * products of one vector with each of numRows rows */
+template <typename fptype, typename rettype,
+          void (*dps)(const fptype *, const fptype *, unsigned,
+                      unsigned, rettype *)>
+__attribute__((flatten)) void baselineBatchKernel(
+    const fptype *query, const fptype *rows, unsigned numRows,
+    unsigned len, rettype *results) {
+  dps(query, rows, numRows, len, results);
+}
+
+template <typename fptype, typename rettype,
+          void (*dps)(const fptype *, const fptype *, unsigned,
+                      unsigned, rettype *)>
+__attribute__((target("avx2,fma"), flatten)) void
+avx2BatchKernel(const fptype *query, const fptype *rows,
+                unsigned numRows, unsigned len,
+                rettype *results) {
+  dps(query, rows, numRows, len, results);
+}
+
+template <typename fptype, typename rettype,
+          void (*dps)(const fptype *, const fptype *, unsigned,
+                      unsigned, rettype *)>
+__attribute__((target("avx512f,avx512dq,avx2,fma,"
+                      "prefer-vector-width=512"),
+               flatten)) void
+avx512BatchKernel(const fptype *query, const fptype *rows,
+                  unsigned numRows, unsigned len,
+                  rettype *results) {
+  dps(query, rows, numRows, len, results);
+}
+
+#endif
+
+/* Returns the build of dp best suited to this CPU */
+template <typename fptype, typename rettype,
+          rettype (*dp)(const fptype *, const fptype *,
+                        unsigned)>
+rettype (*dispatchKernel())(const fptype *,
+                            const fptype *, unsigned) {
+#ifdef DISPATCH_X86
+  switch(cpuFeatures()) {
+    case cpuAVX512:
+      return avx512Kernel<fptype, rettype, dp>;
+    case cpuAVX2:
+      return avx2Kernel<fptype, rettype, dp>;
+    default:
+      return baselineKernel<fptype, rettype, dp>;
+  }
+#else
+  return dp;
+#endif
+}
+
+/* Returns the build of the batch kernel dps best suited
+ * to this CPU */
+template <typename fptype, typename rettype,
+          void (*dps)(const fptype *, const fptype *, unsigned,
+                      unsigned, rettype *)>
+void (*dispatchBatchKernel())(const fptype *,
+                              const fptype *, unsigned,
+                              unsigned, rettype *) {
+#ifdef DISPATCH_X86
+  switch(cpuFeatures()) {
+    case cpuAVX512:
+      return avx512BatchKernel<fptype, rettype, dps>;
+    case cpuAVX2:
+      return avx2BatchKernel<fptype, rettype, dps>;
+    default:
+      return baselineBatchKernel<fptype, rettype, dps>;
+  }
+#else
+  return dps;
+#endif
+}
+
+#endif
@@ -1,17 +1,32 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <time.h>
 #include <gtest/gtest.h>
 #include <unistd.h>
 #include <getopt.h>
 
 #include <random>
+#include <thread>
+#include <vector>
 
 #include <mpfr.h>
 
+#include "accsum.hpp"
 #include "accurate_math.hpp"
+#include "dispatch.hpp"
+#include "expansion.hpp"
+#include "fixed_point.hpp"
+#include "dd_real.hpp"
 #include "kobbelt.hpp"
+#include "kulisch.hpp"
+#include "mixed_precision.hpp"
+#include "online_sum.hpp"
+#include "ozaki.hpp"
+#include "reproducible.hpp"
+#include "superaccumulator.hpp"
+#include "thread_pool.hpp"
 
 template <typename fptype>
 void genVector(
@@ -32,20 +47,68 @@ fptype dotProd(const fptype *v1, const fptype *v2,
   return total;
 }
 
+template <typename fptype>
+inline void kahanDotStep(fptype &total, fptype &c,
+                         fptype a, fptype b) {
+  using std::fma;
+  fptype mod = fma(a, b, -c);
+  fptype tmp = total + mod;
+  c = (tmp - total) - mod;
+  total = tmp;
+}
+
 template <typename fptype>
 fptype kahanDotProd(const fptype *v1, const fptype *v2,
                     unsigned len) {
   fptype total = 0.0;
   fptype c = 0.0;
-  for(unsigned i = 0; i < len; i++) {
-    fptype mod = std::fma(v1[i], v2[i], -c);
-    fptype tmp = total + mod;
-    c = (tmp - total) - mod;
-    total = tmp;
-  }
+  for(unsigned i = 0; i < len; i++)
+    kahanDotStep(total, c, v1[i], v2[i]);
   return total;
 }
 
+/* Kahan dot product with a (total, c) pair per lane and
+ * per unrolled pack, so the loop is bound by throughput
+ * rather than by the latency of a single compensation
+ * chain. The lanes are reduced with a Kahan sum whose
+ * compensation starts out as the sum of the lanes'
+ * outstanding corrections.
+ */
+template <typename fptype,
+          unsigned lanes = simdWidest<fptype>::width,
+          unsigned unroll = 2>
+fptype simdKahanDotProd(const fptype *v1, const fptype *v2,
+                        unsigned len) {
+  typedef simd<fptype, lanes> vec;
+  constexpr const unsigned block = lanes * unroll;
+  vec total[unroll];
+  vec c[unroll];
+  for(unsigned u = 0; u < unroll; u++) {
+    total[u] = 0.0;
+    c[u] = 0.0;
+  }
+  unsigned i = 0;
+  for(; i + block <= len; i += block) {
+    for(unsigned u = 0; u < unroll; u++)
+      kahanDotStep(total[u], c[u],
+                   vec::load(v1 + i + u * lanes),
+                   vec::load(v2 + i + u * lanes));
+  }
+  fptype ret = 0.0;
+  fptype comp = 0.0;
+  for(; i < len; i++) kahanDotStep(ret, comp, v1[i], v2[i]);
+  for(unsigned u = 0; u < unroll; u++) comp += c[u].reduceAdd();
+  for(unsigned u = 0; u < unroll; u++) {
+    for(unsigned j = 0; j < lanes; j++) {
+      fptype mod = total[u][j] - comp;
+      fptype tmp = ret + mod;
+      comp = (tmp - ret) - mod;
+      ret = tmp;
+    }
+  }
+  return ret - comp;
+}
+
 template <typename fptype>
 fptype fmaDotProd(const fptype *v1, const fptype *v2,
                   unsigned len) {
@@ -55,28 +118,173 @@ fptype fmaDotProd(const fptype *v1, const fptype *v2,
   return total;
 }
 
+/* dotProd and fmaDotProd with the sum split over
+ * accumulators independent totals, each loop iteration
+ * covering unroll consecutive blocks of them.
+ * Element i always goes to total[i % accumulators], so
+ * the result only depends on the number of accumulators.
+ * Use -u to find the best setting for a machine.
+ */
+template <typename fptype, unsigned accumulators = 16,
+          unsigned unroll = 1>
+fptype dotProdN(const fptype *v1, const fptype *v2,
+                unsigned len) {
+  constexpr const unsigned block = accumulators * unroll;
+  fptype total[accumulators] = {};
+  unsigned i = 0;
+  for(; i + block <= len; i += block) {
+    for(unsigned u = 0; u < block; u += accumulators) {
+      for(unsigned j = 0; j < accumulators; j++)
+        total[j] += v1[i + u + j] * v2[i + u + j];
+    }
+  }
+  for(unsigned j = 0; i + j < len; j++)
+    total[j % accumulators] += v1[i + j] * v2[i + j];
+  fptype ret = 0.0;
+  for(unsigned j = 0; j < accumulators; j++)
+    ret += total[j];
+  return ret;
+}
+
+template <typename fptype, unsigned accumulators = 16,
+          unsigned unroll = 1>
+fptype fmaDotProdN(const fptype *v1, const fptype *v2,
+                   unsigned len) {
+  constexpr const unsigned block = accumulators * unroll;
+  fptype total[accumulators] = {};
+  unsigned i = 0;
+  for(; i + block <= len; i += block) {
+    for(unsigned u = 0; u < block; u += accumulators) {
+      for(unsigned j = 0; j < accumulators; j++)
+        total[j] =
+            std::fma(v1[i + u + j], v2[i + u + j], total[j]);
+    }
+  }
+  for(unsigned j = 0; i + j < len; j++)
+    total[j % accumulators] = std::fma(
+        v1[i + j], v2[i + j], total[j % accumulators]);
+  fptype ret = 0.0;
+  for(unsigned j = 0; j < accumulators; j++)
+    ret += total[j];
+  return ret;
+}
+
+/* Sets an MPFR variable exactly from each input type */
+inline void mpfrSet(mpfr_ptr dest, float val) {
+  mpfr_set_flt(dest, val, MPFR_RNDN);
+}
+
+inline void mpfrSet(mpfr_ptr dest, double val) {
+  mpfr_set_d(dest, val, MPFR_RNDN);
+}
+
+/* A reusable MPFR context for exact dot products.
+ * The variables are allocated once, the sum with room for
+ * the widest exponent range fptype allows. Each dot
+ * product then sets the sum's precision to just what the
+ * exponent range of its inputs needs to never round, which
+ * MPFR does without allocating, and adds the products with
+ * mpfr_fma.
+ */
+template <typename fptype>
+class mpfrDotProdContext {
+ public:
+  typedef fpconvert<fptype> fields;
+
+  /* The correctly rounded dot product, and what is left
+   * of the exact one. The residual here is rounded to long
+   * double, so only its leading 64 bits are kept; the
+   * exact value is in exactResidual */
+  struct result {
+    double rounded;
+    long double residual;
+  };
+
+  /* The bits of exponent range products may span, plus
+   * room for the mantissas and 2^32 terms */
+  static const mpfr_prec_t maxPrecision =
+      2 * ((1 << fields::eBits) - 3) +
+      2 * fields::precision + 32 + 2;
+
+  mpfrDotProdContext() {
+    mpfr_init2(total, maxPrecision);
+    mpfr_init2(val1, fields::precision);
+    mpfr_init2(val2, fields::precision);
+  }
+
+  ~mpfrDotProdContext() {
+    mpfr_clear(val2);
+    mpfr_clear(val1);
+    mpfr_clear(total);
+  }
+
+  result dotProd(const fptype *v1, const fptype *v2,
+                 unsigned len) {
+    accumulate(v1, v2, len);
+    result ret;
+    ret.rounded = mpfr_get_d(total, MPFR_RNDN);
+    ret.residual = 0.0;
+    if(std::isfinite(ret.rounded)) {
+      /* Exact, as total has room for every bit of it */
+      mpfr_sub_d(total, total, ret.rounded, MPFR_RNDN);
+      ret.residual = mpfr_get_ld(total, MPFR_RNDN);
+    } else {
+      mpfr_set_flt(total, 0, MPFR_RNDN);
+    }
+    return ret;
+  }
+
+  /* The exact residual of the last dotProd, valid until
+   * the next call; zero if the rounded result wasn't
+   * finite */
+  mpfr_srcptr exactResidual() const { return total; }
+
+ private:
+  /* Enough bits for the sum of len products to be exact */
+  static mpfr_prec_t exactPrecision(const fptype *v1,
+                                    const fptype *v2,
+                                    unsigned len) {
+    unsigned min1, max1, min2, max2;
+    if(!exponentRange(v1, len, min1, max1) ||
+       !exponentRange(v2, len, min2, max2) ||
+       min1 > max1 || min2 > max2) {
+      /* Infinities, NaNs and zeros need no precision */
+      return fields::precision;
+    }
+    int countBits = 0;
+    while((1ull << countBits) < len) countBits++;
+    return (max1 + max2) - (min1 + min2) +
+           2 * fields::precision + countBits + 2;
+  }
+
+  /* Sets total to the exact dot product */
+  void accumulate(const fptype *v1, const fptype *v2,
+                  unsigned len) {
+    mpfr_set_prec(total, exactPrecision(v1, v2, len));
+    mpfr_set_flt(total, 0, MPFR_RNDN);
+    for(unsigned i = 0; i < len; i++) {
+      mpfrSet(val1, v1[i]);
+      mpfrSet(val2, v2[i]);
+      mpfr_fma(total, val1, val2, total, MPFR_RNDN);
+    }
+  }
+
+  mpfr_t total, val1, val2;
+};
+
+/* The oracle's context, one per thread */
+template <typename fptype>
+mpfrDotProdContext<fptype> &mpfrContext() {
+  static thread_local mpfrDotProdContext<fptype> context;
+  return context;
+}
+
 template <typename fptype>
 long double correctDotProd(const fptype *v1,
                            const fptype *v2, unsigned len) {
-  mpfr_t total, prod, val1, val2;
-  constexpr const int mpfrprecision = 65536;
-  mpfr_init2(total, mpfrprecision);
-  mpfr_init2(prod, mpfrprecision);
-  mpfr_init2(val1, mpfrprecision);
-  mpfr_init2(val2, mpfrprecision);
-  mpfr_set_flt(total, 0, MPFR_RNDN);
-  for(unsigned i = 0; i < len; i++) {
-    mpfr_set_ld(val1, v1[i], MPFR_RNDN);
-    mpfr_set_ld(val2, v2[i], MPFR_RNDN);
-    mpfr_mul(prod, val1, val2, MPFR_RNDN);
-    mpfr_add(total, total, prod, MPFR_RNDN);
-  }
-  long double result = mpfr_get_ld(total, MPFR_RNDN);
-  mpfr_clear(val2);
-  mpfr_clear(val1);
-  mpfr_clear(prod);
-  mpfr_clear(total);
-  return result;
+  typename mpfrDotProdContext<fptype>::result exact =
+      mpfrContext<fptype>().dotProd(v1, v2, len);
+  return exact.rounded + exact.residual;
 }
 
 struct timespec subtractTimes(struct timespec start,
@@ -110,11 +318,18 @@ struct testResult {
   fptype result;
 };
 
-template <typename fptype, typename retType,
-          retType (*dp)(const fptype *, const fptype *,
-                        unsigned len)>
-testResult<retType> testFunction(fptype *vec1, fptype *vec2,
-                                 unsigned len) {
+template <typename fptype, typename retType>
+testResult<retType> testFunction(
+    retType (*dp)(const fptype *, const fptype *,
+                  unsigned len),
+    fptype *vec1, fptype *vec2, unsigned len,
+    bool timed = true) {
+  if(!timed) {
+    struct testResult<retType> ret = {
+      { 0, 0 }, dp(vec1, vec2, len)
+    };
+    return ret;
+  }
   struct timespec start;
   int error =
       clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &start);
@@ -130,179 +345,890 @@ testResult<retType> testFunction(fptype *vec1, fptype *vec2,
   return ret;
 }
 
-void parseOptions(int argc, char **argv, int &testSize,
-                  int &numTests) {
-  int ret = 0;
-  do {
-    ret = getopt(argc, argv, "d:t:");
-    switch(ret) {
-      case 'd':
-        testSize = atoi(optarg);
-        break;
-      case 't':
-        numTests = atoi(optarg);
-        break;
+template <typename fptype, typename rettype = fptype>
+struct dotProdKernel {
+  const char *name;
+  rettype (*dp)(const fptype *, const fptype *,
+                unsigned len);
+};
+
+/* Lets a kernel returning fptype sit in a table of
+ * kernels returning the wider rettype */
+template <typename fptype, typename rettype,
+          fptype (*dp)(const fptype *, const fptype *,
+                       unsigned)>
+rettype resultAs(const fptype *v1, const fptype *v2,
+                 unsigned len) {
+  return dp(v1, v2, len);
+}
+
+/* Rounds the result of a kernel returning an extended
+ * rettype, such as ddReal, to fptype */
+template <typename fptype, typename rettype,
+          rettype (*dp)(const fptype *, const fptype *,
+                        unsigned)>
+fptype roundedResult(const fptype *v1, const fptype *v2,
+                     unsigned len) {
+  return fptype(dp(v1, v2, len));
+}
+
+struct kernelStats {
+  struct timespec runningTime;
+  long double totalErr;
+  long double totalBitsWrong;
+  long double maxBitsWrong;
+};
+
+template <typename fptype>
+void recordResult(kernelStats &stats,
+                  const testResult<fptype> &result,
+                  long double correct) {
+  stats.runningTime =
+      addTimes(result.elapsedTime, stats.runningTime);
+  double err = std::fabs(result.result - correct);
+  if(err != 0.0f && correct != 0.0f) {
+    double relErr = err / std::fabs(correct);
+    double inaccurateBits = std::log(relErr) / std::log(2);
+    stats.totalBitsWrong += inaccurateBits;
+    if(inaccurateBits > stats.maxBitsWrong)
+      stats.maxBitsWrong = inaccurateBits;
+  }
+  stats.totalErr += err;
+}
+
+/* Adds the errors in from to into. Running times are only
+ * kept for the timed tests, so aren't merged */
+void mergeErrors(kernelStats &into,
+                 const kernelStats &from) {
+  into.totalErr += from.totalErr;
+  into.totalBitsWrong += from.totalBitsWrong;
+  if(from.maxBitsWrong > into.maxBitsWrong)
+    into.maxBitsWrong = from.maxBitsWrong;
+}
+
+void resetStats(kernelStats *stats, int tests) {
+  memset(stats, 0, sizeof(stats[0]) * tests);
+  for(int i = 0; i < tests; i++)
+    stats[i].maxBitsWrong = -1.0 / 0.0;
+  assert(std::isinf(stats[0].maxBitsWrong));
+}
+
+template <typename fptype>
+struct unrollSetting {
+  unsigned accumulators;
+  unsigned unroll;
+  fptype (*naive)(const fptype *, const fptype *,
+                  unsigned len);
+  fptype (*fma)(const fptype *, const fptype *,
+                unsigned len);
+};
+
+template <typename fptype, unsigned accumulators,
+          unsigned unroll>
+unrollSetting<fptype> makeUnrollSetting() {
+  unrollSetting<fptype> setting = {
+    accumulators, unroll,
+    dispatchKernel<
+        fptype, fptype,
+        dotProdN<fptype, accumulators, unroll> >(),
+    dispatchKernel<
+        fptype, fptype,
+        fmaDotProdN<fptype, accumulators, unroll> >()
+  };
+  return setting;
+}
+
+template <typename fptype>
+double timeKernel(fptype (*dp)(const fptype *,
+                               const fptype *, unsigned),
+                  const fptype *vec1, const fptype *vec2,
+                  unsigned len, int reps) {
+  volatile fptype sink = 0.0;
+  struct timespec start;
+  int error =
+      clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &start);
+  assert(!error);
+  for(int i = 0; i < reps; i++) sink = dp(vec1, vec2, len);
+  struct timespec end;
+  error = clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &end);
+  assert(!error);
+  (void)sink;
+  struct timespec delta = subtractTimes(start, end);
+  return delta.tv_sec + delta.tv_nsec / 1e9;
+}
+
+/* Times dotProdN and fmaDotProdN over a range of
+ * accumulator counts and unroll depths, reporting the
+ * time per element and the fastest setting of each */
+template <typename fptype>
+void unrollSweep(int testSize, int numTests) {
+  const unrollSetting<fptype> settings[] = {
+    makeUnrollSetting<fptype, 1, 1>(),
+    makeUnrollSetting<fptype, 2, 1>(),
+    makeUnrollSetting<fptype, 4, 1>(),
+    makeUnrollSetting<fptype, 4, 2>(),
+    makeUnrollSetting<fptype, 8, 1>(),
+    makeUnrollSetting<fptype, 8, 2>(),
+    makeUnrollSetting<fptype, 8, 4>(),
+    makeUnrollSetting<fptype, 16, 1>(),
+    makeUnrollSetting<fptype, 16, 2>(),
+    makeUnrollSetting<fptype, 32, 1>(),
+    makeUnrollSetting<fptype, 32, 2>(),
+    makeUnrollSetting<fptype, 64, 1>()
+  };
+  constexpr const int numSettings =
+      sizeof(settings) / sizeof(settings[0]);
+  fptype *vec1, *vec2;
+  vec1 = (fptype *)malloc(sizeof(fptype[testSize]));
+  vec2 = (fptype *)malloc(sizeof(fptype[testSize]));
+  assert(vec1 != NULL);
+  assert(vec2 != NULL);
+  std::random_device rd;
+  std::mt19937_64 engine(rd());
+  std::uniform_real_distribution<fptype> rgenf(-1.0, 1.0);
+  genVector(vec1, testSize, engine, rgenf);
+  genVector(vec2, testSize, engine, rgenf);
+  const double elements = (double)testSize * numTests;
+  int bestNaive = 0, bestFMA = 0;
+  double bestNaiveTime = 1.0 / 0.0;
+  double bestFMATime = 1.0 / 0.0;
+  printf("Unroll sweep over %d tests of size %d using %s "
+         "kernels\n",
+         numTests, testSize, cpuLevelName(cpuFeatures()));
+  for(int i = 0; i < numSettings; i++) {
+    double naiveTime = timeKernel(settings[i].naive, vec1,
+                                  vec2, testSize, numTests);
+    double fmaTime = timeKernel(settings[i].fma, vec1, vec2,
+                                testSize, numTests);
+    printf("Accumulators %2u Unroll %u: "
+           "Naive %.3f ns/elem; FMA %.3f ns/elem\n",
+           settings[i].accumulators, settings[i].unroll,
+           naiveTime / elements * 1e9,
+           fmaTime / elements * 1e9);
+    if(naiveTime < bestNaiveTime) {
+      bestNaiveTime = naiveTime;
+      bestNaive = i;
     }
-  } while(ret != -1);
+    if(fmaTime < bestFMATime) {
+      bestFMATime = fmaTime;
+      bestFMA = i;
+    }
+  }
+  printf("Best Naive: dotProdN<%u, %u>; "
+         "Best FMA: fmaDotProdN<%u, %u>\n",
+         settings[bestNaive].accumulators,
+         settings[bestNaive].unroll,
+         settings[bestFMA].accumulators,
+         settings[bestFMA].unroll);
+  free(vec2);
+  free(vec1);
 }
 
-int main(int argc, char **argv) {
-  int testSize = 1024;
-  int numTests = 65536;
-  typedef double fptype;
-  parseOptions(argc, argv, testSize, numTests);
+/* The data distributions the carry chain benchmark
+ * measures tableInsert on */
+enum carryDistribution {
+  uniformMaxMag,
+  uniformUnit,
+  wideExponents,
+  cancellingPairs,
+  numCarryDistributions
+};
+
+const char *carryDistributionName(int dist) {
+  switch(dist) {
+    case uniformMaxMag:
+      return "Uniform +-2^20";
+    case uniformUnit:
+      return "Uniform +-1";
+    case wideExponents:
+      return "Exponents 2^-100 to 2^100";
+    default:
+      return "Cancelling pairs";
+  }
+}
+
+template <typename fptype>
+void genCarryVectors(int dist, fptype *vec1, fptype *vec2,
+                     unsigned vecSize,
+                     std::mt19937_64 &rgen) {
+  const fptype maxMag =
+      dist == uniformMaxMag ? 1024.0 * 1024.0 : 1.0;
+  std::uniform_real_distribution<fptype> rgenf(-maxMag,
+                                               maxMag);
+  genVector(vec1, vecSize, rgen, rgenf);
+  genVector(vec2, vecSize, rgen, rgenf);
+  if(dist == wideExponents) {
+    std::uniform_int_distribution<int> rgenExp(-100, 100);
+    for(unsigned i = 0; i < vecSize; i++) {
+      vec1[i] = std::ldexp(vec1[i], rgenExp(rgen));
+      vec2[i] = std::ldexp(vec2[i], rgenExp(rgen));
+    }
+  } else if(dist == cancellingPairs) {
+    /* The second half of the products negates the first */
+    for(unsigned i = 0; i < vecSize / 2; i++) {
+      vec1[vecSize / 2 + i] = vec1[i];
+      vec2[vecSize / 2 + i] = -vec2[i];
+    }
+  }
+}
 
+/* Reports the average and longest carry chain of
+ * tableInsert while computing Kobbelt dot products */
+template <typename fptype>
+void carryChainBenchmark(int testSize, int numTests) {
   fptype *vec1, *vec2;
   vec1 = (fptype *)malloc(sizeof(fptype[testSize]));
   vec2 = (fptype *)malloc(sizeof(fptype[testSize]));
   assert(vec1 != NULL);
   assert(vec2 != NULL);
+  std::random_device rd;
+  std::mt19937_64 engine(rd());
+  printf("Carry chains over %d tests of size %d\n", numTests,
+         testSize);
+  for(int dist = 0; dist < numCarryDistributions; dist++) {
+    unsigned long long totalCarries = 0;
+    unsigned maxCarries = 0;
+    for(int i = 0; i < numTests; i++) {
+      genCarryVectors(dist, vec1, vec2, testSize, engine);
+      genusTable<fptype> table;
+      for(int j = 0; j < testSize; j++) {
+        std::array<fptype, 2> prod =
+            twoProd(vec1[j], vec2[j]);
+        for(int k = 0; k < 2; k++) {
+          unsigned carries = tableInsert(table, prod[k]);
+          totalCarries += carries;
+          if(carries > maxCarries) maxCarries = carries;
+        }
+      }
+    }
+    printf("%s: Average Carry Chain %f; "
+           "Maximum Carry Chain %u\n",
+           carryDistributionName(dist),
+           (double)totalCarries / (2.0 * testSize * numTests),
+           maxCarries);
+  }
+  free(vec2);
+  free(vec1);
+}
+
+/* The sign from the exact expansion alone, to compare
+ * against adaptiveDotSign */
+template <typename fptype>
+dotSignResult exactDotSign(const fptype *v1,
+                           const fptype *v2, unsigned len) {
+  dotSignResult ret = {
+    expansionSign(dotProdExpansion(v1, v2, len)),
+    dotSignExact
+  };
+  return ret;
+}
+
+/* Reports how often adaptiveDotSign stops at each stage,
+ * checks its signs against the Kulisch result, and times
+ * it against computing every sign exactly */
+template <typename fptype>
+void signPredicateBenchmark(int testSize, int numTests) {
+  fptype *vec1, *vec2;
+  vec1 = (fptype *)malloc(sizeof(fptype[testSize]));
+  vec2 = (fptype *)malloc(sizeof(fptype[testSize]));
+  assert(vec1 != NULL);
+  assert(vec2 != NULL);
+  std::random_device rd;
+  std::mt19937_64 engine(rd());
+  dotSignResult (*adaptive)(const fptype *, const fptype *,
+                            unsigned) =
+      dispatchKernel<fptype, dotSignResult,
+                     adaptiveDotSign<fptype> >();
+  dotSignResult (*exact)(const fptype *, const fptype *,
+                         unsigned) =
+      dispatchKernel<fptype, dotSignResult,
+                     exactDotSign<fptype> >();
+  printf("Sign predicates over %d tests of size %d\n",
+         numTests, testSize);
+  for(int dist = 0; dist < numCarryDistributions; dist++) {
+    int stages[dotSignExact + 1] = {};
+    int wrong = 0;
+    struct timespec adaptiveTime, exactTime;
+    memset(&adaptiveTime, 0, sizeof(adaptiveTime));
+    memset(&exactTime, 0, sizeof(exactTime));
+    for(int i = 0; i < numTests; i++) {
+      genCarryVectors(dist, vec1, vec2, testSize, engine);
+      struct testResult<dotSignResult> result =
+          testFunction(adaptive, vec1, vec2, testSize);
+      adaptiveTime =
+          addTimes(result.elapsedTime, adaptiveTime);
+      struct testResult<dotSignResult> exactResult =
+          testFunction(exact, vec1, vec2, testSize);
+      exactTime = addTimes(exactResult.elapsedTime, exactTime);
+      fptype correct =
+          kulischDotProd<fptype>(vec1, vec2, testSize);
+      stages[result.result.stage]++;
+      if(result.result.sign != sign(correct)) wrong++;
+    }
+    printf("%s: Adaptive Time %ld.%09ld s; Exact Time "
+           "%ld.%09ld s; Wrong Signs %d",
+           carryDistributionName(dist),
+           adaptiveTime.tv_sec, adaptiveTime.tv_nsec,
+           exactTime.tv_sec, exactTime.tv_nsec, wrong);
+    for(int stage = 0; stage <= dotSignExact; stage++)
+      printf("; %s %d",
+             dotSignStageName((dotSignStage)stage),
+             stages[stage]);
+    printf("\n");
+  }
+  free(vec2);
+  free(vec1);
+}
+
+template <typename fptype>
+void scaleVector(fptype *x, unsigned long n, int exp) {
+  for(unsigned long i = 0; i < n; i++)
+    x[i] = std::ldexp(x[i], exp);
+}
+
+/* The number of rows of results which differ from the
+ * Kulisch dot products of query and rows */
+template <typename fptype>
+int countWrongRows(const fptype *query, const fptype *rows,
+                   int numRows, int testSize,
+                   const fptype *results) {
+  int wrong = 0;
+  for(int r = 0; r < numRows; r++) {
+    fptype exact = kulischDotProd<fptype, fptype>(
+        query, rows + (unsigned long)r * testSize,
+        testSize);
+    if(results[r] != exact &&
+       !(std::isnan(results[r]) && std::isnan(exact)))
+      wrong++;
+  }
+  return wrong;
+}
+
+/* Times dot products of one query against numRows rows,
+ * with ozakiDotProds against the Kulisch and naive dot
+ * products of each row, and checks that the Ozaki results
+ * are exact, also for inputs scaled to the edges of the
+ * exponent range */
+template <typename fptype>
+void batchBenchmark(int testSize, int numTests,
+                    int numRows) {
+  fptype *query, *rows, *results;
+  query = (fptype *)malloc(sizeof(fptype[testSize]));
+  rows = (fptype *)malloc(sizeof(fptype) * testSize *
+                          (unsigned long)numRows);
+  results = (fptype *)malloc(sizeof(fptype[numRows]));
+  assert(query != NULL);
+  assert(rows != NULL);
+  assert(results != NULL);
   constexpr const fptype maxMag = 1024.0 * 1024.0;
   std::random_device rd;
   std::mt19937_64 engine(rd());
   std::uniform_real_distribution<fptype> rgenf(-maxMag,
                                                maxMag);
-  constexpr const int tests = 5;
-  struct timespec runningTimes[tests + 1];
-  memset(&runningTimes, 0, sizeof(runningTimes));
-  long double totalErr[tests];
-  memset(&totalErr, 0, sizeof(totalErr));
-  long double totalBitsWrong[tests];
-  memset(&totalBitsWrong, 0, sizeof(totalBitsWrong));
-  long double maxBitsWrong[tests];
-  for(int i = 0; i < tests; i++)
-    maxBitsWrong[i] = -1.0 / 0.0;
-  assert(std::isinf(maxBitsWrong[0]));
+  struct timespec ozakiTime, kulischTime, naiveTime;
+  memset(&ozakiTime, 0, sizeof(ozakiTime));
+  memset(&kulischTime, 0, sizeof(kulischTime));
+  memset(&naiveTime, 0, sizeof(naiveTime));
+  void (*ozaki)(const fptype *, const fptype *, unsigned,
+                unsigned, fptype *) =
+      dispatchBatchKernel<fptype, fptype,
+                          ozakiDotProds<fptype, fptype> >();
+  fptype (*kulisch)(const fptype *, const fptype *,
+                    unsigned) =
+      dispatchKernel<fptype, fptype,
+                     kulischDotProd<fptype, fptype> >();
+  fptype (*naive)(const fptype *, const fptype *, unsigned) =
+      dispatchKernel<fptype, fptype, dotProd<fptype> >();
+  int wrong = 0, naiveWrong = 0, extremeWrong = 0;
   for(int i = 0; i < numTests; i++) {
-    genVector(vec1, testSize, engine, rgenf);
-    genVector(vec2, testSize, engine, rgenf);
-    struct testResult<long double> correctResult =
-        testFunction<fptype, long double,
-                     correctDotProd<fptype> >(vec1, vec2,
-                                              testSize);
-    runningTimes[0] = addTimes(correctResult.elapsedTime,
-                               runningTimes[0]);
-
-    struct testResult<fptype> spResult =
-        testFunction<fptype, fptype, dotProd<fptype> >(
-            vec1, vec2, testSize);
-    runningTimes[1] =
-        addTimes(spResult.elapsedTime, runningTimes[1]);
-    double err1 =
-        std::fabs(spResult.result - correctResult.result);
-    if(err1 != 0.0f && correctResult.result != 0.0f) {
-      double relErr =
-          err1 / std::fabs(correctResult.result);
-      double inaccurateBits =
-          std::log(relErr) / std::log(2);
-      totalBitsWrong[0] += inaccurateBits;
-      if(inaccurateBits > maxBitsWrong[0])
-        maxBitsWrong[0] = inaccurateBits;
-    }
-    totalErr[0] += err1;
-
-    struct testResult<fptype> compensatedResult =
-        testFunction<fptype, fptype,
-                     compensatedDotProd<fptype> >(
-            vec1, vec2, testSize);
-    runningTimes[2] = addTimes(
-        compensatedResult.elapsedTime, runningTimes[2]);
-    double err2 = std::fabs(compensatedResult.result -
-                            correctResult.result);
-    if(err2 != 0.0f && correctResult.result != 0.0f) {
-      double relErr =
-          err2 / std::fabs(correctResult.result);
-      double inaccurateBits =
-          std::log(relErr) / std::log(2);
-      totalBitsWrong[1] += inaccurateBits;
-      if(inaccurateBits > maxBitsWrong[1])
-        maxBitsWrong[1] = inaccurateBits;
+    genVector(query, testSize, engine, rgenf);
+    genVector(rows, testSize * numRows, engine, rgenf);
+    struct timespec start, end;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &start);
+    ozaki(query, rows, numRows, testSize, results);
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &end);
+    ozakiTime = addTimes(subtractTimes(start, end), ozakiTime);
+    for(int r = 0; r < numRows; r++) {
+      fptype *row = rows + (unsigned long)r * testSize;
+      struct testResult<fptype> exact =
+          testFunction(kulisch, query, row, testSize);
+      kulischTime = addTimes(exact.elapsedTime, kulischTime);
+      struct testResult<fptype> rounded =
+          testFunction(naive, query, row, testSize);
+      naiveTime = addTimes(rounded.elapsedTime, naiveTime);
+      if(results[r] != exact.result) wrong++;
+      if(rounded.result != exact.result) naiveWrong++;
     }
-    totalErr[1] += err2;
-
-    struct testResult<fptype> kahanResult =
-        testFunction<fptype, fptype, kahanDotProd<fptype> >(
-            vec1, vec2, testSize);
-    runningTimes[3] =
-        addTimes(kahanResult.elapsedTime, runningTimes[3]);
-    double err3 = std::fabs(kahanResult.result -
-                            correctResult.result);
-    if(err3 != 0.0f && correctResult.result != 0.0f) {
-      double relErr =
-          err3 / std::fabs(correctResult.result);
-      double inaccurateBits =
-          std::log(relErr) / std::log(2);
-      totalBitsWrong[2] += inaccurateBits;
-      if(inaccurateBits > maxBitsWrong[2])
-        maxBitsWrong[2] = inaccurateBits;
+    /* A query near overflow, whose products overflow */
+    typedef std::numeric_limits<fptype> limits;
+    const int highExp = limits::max_exponent - 24;
+    scaleVector(query, testSize, highExp);
+    ozaki(query, rows, numRows, testSize, results);
+    extremeWrong += countWrongRows(query, rows, numRows,
+                                   testSize, results);
+    scaleVector(query, testSize, -highExp);
+    /* Products around the smallest subnormal */
+    const int lowExp =
+        (limits::min_exponent - limits::digits) / 2 - 10;
+    scaleVector(query, testSize, lowExp);
+    scaleVector(rows, (unsigned long)testSize * numRows,
+                lowExp);
+    ozaki(query, rows, numRows, testSize, results);
+    extremeWrong += countWrongRows(query, rows, numRows,
+                                   testSize, results);
+  }
+  printf("Ran %d batches of %d rows of size %d\n"
+         "Ozaki Time: %ld.%09ld s; Wrong Results %d\n"
+         "Kulisch Time: %ld.%09ld s\n"
+         "Naive Time: %ld.%09ld s; Wrong Results %d\n"
+         "Extreme Exponents Ozaki Wrong Results %d\n",
+         numTests, numRows, testSize, ozakiTime.tv_sec,
+         ozakiTime.tv_nsec, wrong, kulischTime.tv_sec,
+         kulischTime.tv_nsec, naiveTime.tv_sec,
+         naiveTime.tv_nsec, naiveWrong, extremeWrong);
+  free(results);
+  free(rows);
+  free(query);
+}
+
+/* Dot products at the edges of the exponent range, run
+ * through the kernels which promise at least faithful
+ * results and checked against kulischDotProd */
+template <typename fptype>
+struct edgeCase {
+  const char *name;
+  std::vector<fptype> v1, v2;
+};
+
+template <typename fptype>
+std::vector<edgeCase<fptype> > makeEdgeCases() {
+  typedef std::numeric_limits<fptype> limits;
+  std::vector<edgeCase<fptype> > cases;
+  edgeCase<fptype> c;
+  c.name = "Product near overflow plus one";
+  c.v1 = {
+    std::ldexp(fptype(1.0), limits::max_exponent - 3), 1.0
+  };
+  c.v2 = { 1.0, 1.0 };
+  cases.push_back(c);
+  c.name = "Product of 3/4 the largest plus one";
+  c.v1 = { limits::max() * fptype(0.75), 1.0 };
+  cases.push_back(c);
+  c.name = "64 terms summing near overflow";
+  c.v1.assign(64, std::ldexp(fptype(1.0),
+                             limits::max_exponent - 9));
+  c.v2.assign(64, 1.0);
+  cases.push_back(c);
+  /* Slices of these round up to powers of two whose dot
+   * product is 2^max_exponent */
+  c.name = "Ozaki slices at the overflow boundary";
+  const int half = limits::max_exponent / 2;
+  const fptype inf = limits::infinity();
+  const fptype top1 = std::ldexp(fptype(1.0), half);
+  const fptype top2 = std::ldexp(fptype(1.0), half - 1);
+  c.v1.assign(2, std::nextafter(top1, -inf));
+  c.v2.assign(2, std::nextafter(top2, -inf));
+  cases.push_back(c);
+  c.name = "Overflowing products which cancel";
+  c.v1 = { limits::max(), -limits::max() };
+  c.v2 = { 2.0, 2.0 };
+  cases.push_back(c);
+  return cases;
+}
+
+/* Prints the cases where a kernel is not faithful, and
+ * how many there were */
+template <typename fptype>
+void edgeCaseCheck() {
+  typedef std::numeric_limits<fptype> limits;
+  const dotProdKernel<fptype> kernels[] = {
+    { "AccDot", accDotProd<fptype> },
+    { "Reproducible", reproDotProd<fptype> },
+    { "SIMD Reproducible", simdReproDotProd<fptype> },
+    { "Parallel Reproducible",
+      parallelReproDotProd<fptype> },
+    { "Ozaki", ozakiDotProd<fptype> }
+  };
+  const int numKernels =
+      sizeof(kernels) / sizeof(kernels[0]);
+  std::vector<edgeCase<fptype> > cases =
+      makeEdgeCases<fptype>();
+  int failures = 0;
+  for(unsigned i = 0; i < cases.size(); i++) {
+    const edgeCase<fptype> &c = cases[i];
+    fptype exact = kulischDotProd<fptype, fptype>(
+        c.v1.data(), c.v2.data(), c.v1.size());
+    for(int j = 0; j < numKernels; j++) {
+      fptype result = kernels[j].dp(
+          c.v1.data(), c.v2.data(), c.v1.size());
+      /* Faithful: exact, or a neighbor of it */
+      const fptype inf = limits::infinity();
+      bool faithful =
+          result == exact ||
+          result == std::nextafter(exact, inf) ||
+          result == std::nextafter(exact, -inf);
+      if(!faithful) {
+        printf("%s: %s gave %a, exact %a\n", c.name,
+               kernels[j].name, result, exact);
+        failures++;
+      }
     }
-    totalErr[2] += err3;
-
-    struct testResult<fptype> fmaResult =
-        testFunction<fptype, fptype, fmaDotProd<fptype> >(
-            vec1, vec2, testSize);
-    runningTimes[4] =
-        addTimes(fmaResult.elapsedTime, runningTimes[4]);
-    double err4 =
-        std::fabs(fmaResult.result - correctResult.result);
-    if(err4 != 0.0f && correctResult.result != 0.0f) {
-      double relErr =
-          err4 / std::fabs(correctResult.result);
-      double inaccurateBits =
-          std::log(relErr) / std::log(2);
-      totalBitsWrong[3] += inaccurateBits;
-      if(inaccurateBits > maxBitsWrong[3])
-        maxBitsWrong[3] = inaccurateBits;
+  }
+  printf("Ran %d edge cases on %d kernels; Failures %d\n",
+         (int)cases.size(), numKernels, failures);
+}
+
+template <typename fptype>
+const char *fpTypeName() {
+  return sizeof(fptype) == sizeof(float) ? "float"
+                                         : "double";
+}
+
+/* The reference for the error statistics: MPFR by
+ * default, or the Kulisch accumulator with -l, in which
+ * case the Kulisch row is the reference and has no error */
+template <typename fptype>
+struct dotProdOracle {
+  const char *name;
+  long double (*dp)(const fptype *, const fptype *,
+                    unsigned);
+};
+
+template <typename fptype>
+dotProdOracle<fptype> makeOracle(bool useMPFR) {
+  dotProdOracle<fptype> oracle;
+  if(useMPFR) {
+    oracle.name = "MPFR";
+    oracle.dp = correctDotProd<fptype>;
+  } else {
+    oracle.name = "Kulisch";
+    oracle.dp = kulischDotProd<fptype, long double>;
+  }
+  return oracle;
+}
+
+/* Runs numTests tests with vectors from engine, recording
+ * the kernels' errors and, if timed, their running times
+ * and the oracle's in correctTime */
+template <typename fptype, typename rettype>
+void runTests(const dotProdKernel<fptype, rettype> *kernels,
+              const int tests, int testSize, int numTests,
+              const dotProdOracle<fptype> &oracle,
+              std::mt19937_64 &engine, bool timed,
+              kernelStats *stats,
+              struct timespec &correctTime) {
+  std::vector<fptype> vec1(testSize);
+  std::vector<fptype> vec2(testSize);
+  constexpr const fptype maxMag = 1024.0 * 1024.0;
+  std::uniform_real_distribution<fptype> rgenf(-maxMag,
+                                               maxMag);
+  for(int i = 0; i < numTests; i++) {
+    genVector(vec1.data(), testSize, engine, rgenf);
+    genVector(vec2.data(), testSize, engine, rgenf);
+    struct testResult<long double> correctResult =
+        testFunction(oracle.dp, vec1.data(), vec2.data(),
+                     testSize, timed);
+    correctTime =
+        addTimes(correctResult.elapsedTime, correctTime);
+    for(int j = 0; j < tests; j++) {
+      struct testResult<rettype> result =
+          testFunction(kernels[j].dp, vec1.data(),
+                       vec2.data(), testSize, timed);
+      recordResult(stats[j], result, correctResult.result);
     }
-    totalErr[3] += err4;
-
-    struct testResult<fptype> kobbeltResult =
-        testFunction<fptype, fptype, kobbeltDotProd<fptype> >(
-            vec1, vec2, testSize);
-    runningTimes[5] =
-        addTimes(kobbeltResult.elapsedTime, runningTimes[5]);
-    double err5 =
-        std::fabs(kobbeltResult.result - correctResult.result);
-    if(err5 != 0.0f && correctResult.result != 0.0f) {
-      double relErr =
-          err5 / std::fabs(correctResult.result);
-      double inaccurateBits =
-          std::log(relErr) / std::log(2);
-      totalBitsWrong[4] += inaccurateBits;
-      if(inaccurateBits > maxBitsWrong[3])
-        maxBitsWrong[4] = inaccurateBits;
+  }
+}
+
+/* The first timedTests tests are timed on this thread
+ * alone, so the times are comparable from run to run. The
+ * rest only measure accuracy, and are split between
+ * numThreads threads, each with its own stream of random
+ * vectors and its own statistics, merged at the end.
+ * Those threads give the parallel kernels a pool of one
+ * each, so their blocks run inline rather than queueing
+ * for the shared defaultThreadPool */
+template <typename fptype, typename rettype>
+void runBenchmark(
+    const dotProdKernel<fptype, rettype> *kernels,
+    const int tests, int testSize, int numTests,
+    int timedTests, unsigned numThreads,
+    const dotProdOracle<fptype> &oracle) {
+  if(timedTests > numTests) timedTests = numTests;
+  std::random_device rd;
+  const unsigned seed = rd();
+  struct timespec correctTime;
+  memset(&correctTime, 0, sizeof(correctTime));
+  kernelStats stats[tests];
+  resetStats(stats, tests);
+  {
+    std::seed_seq seq = { seed, 0u };
+    std::mt19937_64 engine(seq);
+    runTests(kernels, tests, testSize, timedTests, oracle,
+             engine, true, stats, correctTime);
+  }
+  const int untimedTests = numTests - timedTests;
+  if(untimedTests > 0) {
+    std::vector<kernelStats> threadStats(numThreads *
+                                         tests);
+    threadPool pool(numThreads);
+    pool.run(numThreads, [&](unsigned thread) {
+      kernelStats *mine =
+          threadStats.data() + thread * tests;
+      resetStats(mine, tests);
+      threadPool serial(1);
+      scopedDefaultThreadPool useSerial(serial);
+      std::seed_seq seq = { seed, thread + 1 };
+      std::mt19937_64 engine(seq);
+      const int begin =
+          (long long)untimedTests * thread / numThreads;
+      const int end = (long long)untimedTests *
+                      (thread + 1) / numThreads;
+      struct timespec untimed = { 0, 0 };
+      runTests(kernels, tests, testSize, end - begin,
+               oracle, engine, false, mine, untimed);
+    });
+    for(unsigned t = 0; t < numThreads; t++) {
+      for(int j = 0; j < tests; j++)
+        mergeErrors(stats[j], threadStats[t * tests + j]);
     }
-    totalErr[4] += err5;
   }
   printf(
-      "Ran %d tests of size %d\n"
-      "Correct Running Time: %ld.%09ld s\n"
-      "Naive Time: %ld.%09ld s; Average Error %Le; "
-      "Average Bits Wrong: %Le; Maximum Bits Wrong: %Le\n"
-      "Compensated Time: %ld.%09ld s; Average Error %Le; "
-      "Average Bits Wrong: %Le; Maximum Bits Wrong: %Le\n"
-      "Kahan Time: %ld.%09ld s; Average Error %Le; "
-      "Average Bits Wrong: %Le; Maximum Bits Wrong: %Le\n"
-      "FMA Time: %ld.%09ld s; Average Error %Le; "
-      "Average Bits Wrong: %Le; Maximum Bits Wrong: %Le\n"
-      "Kobbelt Time: %ld.%09ld s; Average Error %Le; "
-      "Average Bits Wrong: %Le; Maximum Bits Wrong: %Le\n",
-      numTests, testSize, runningTimes[0].tv_sec,
-      runningTimes[0].tv_nsec, runningTimes[1].tv_sec,
-      runningTimes[1].tv_nsec, totalErr[0] / numTests,
-      totalBitsWrong[0] / numTests, maxBitsWrong[0],
-      runningTimes[2].tv_sec, runningTimes[2].tv_nsec,
-      totalErr[1] / numTests, totalBitsWrong[1] / numTests,
-      maxBitsWrong[1], runningTimes[3].tv_sec,
-      runningTimes[3].tv_nsec, totalErr[2] / numTests,
-      totalBitsWrong[2] / numTests, maxBitsWrong[2],
-      runningTimes[4].tv_sec, runningTimes[4].tv_nsec,
-      totalErr[3] / numTests, totalBitsWrong[3] / numTests,
-      maxBitsWrong[3],
-      runningTimes[5].tv_sec, runningTimes[5].tv_nsec,
-      totalErr[4] / numTests, totalBitsWrong[4] / numTests,
-      maxBitsWrong[4]);
-  free(vec2);
-  free(vec1);
+      "Ran %d tests of size %d with %s inputs using %s "
+      "kernels, timing %d on one thread and checking the "
+      "rest on %u\n"
+      "Correct (%s) Running Time: %ld.%09ld s\n",
+      numTests, testSize, fpTypeName<fptype>(),
+      cpuLevelName(cpuFeatures()), timedTests, numThreads,
+      oracle.name, correctTime.tv_sec, correctTime.tv_nsec);
+  for(int j = 0; j < tests; j++) {
+    if(strcmp(kernels[j].name, oracle.name) == 0) {
+      printf("%s Time: %ld.%09ld s; Reference\n",
+             kernels[j].name, stats[j].runningTime.tv_sec,
+             stats[j].runningTime.tv_nsec);
+      continue;
+    }
+    printf(
+        "%s Time: %ld.%09ld s; Average Error %Le; "
+        "Average Bits Wrong: %Le; Maximum Bits Wrong: "
+        "%Le\n",
+        kernels[j].name, stats[j].runningTime.tv_sec,
+        stats[j].runningTime.tv_nsec,
+        stats[j].totalErr / numTests,
+        stats[j].totalBitsWrong / numTests,
+        stats[j].maxBitsWrong);
+  }
+}
+
+void parseOptions(int argc, char **argv, int &testSize,
+                  int &numTests, bool &sweep,
+                  bool &floatInputs, bool &carryChains,
+                  bool &useMPFR, bool &signs,
+                  bool &edgeCases, int &batchRows,
+                  int &timedTests, unsigned &numThreads) {
+  int ret = 0;
+  do {
+    ret = getopt(argc, argv, "d:t:ufkmlseb:r:j:");
+    switch(ret) {
+      case 'd':
+        testSize = atoi(optarg);
+        break;
+      case 't':
+        numTests = atoi(optarg);
+        break;
+      case 'u':
+        sweep = true;
+        break;
+      case 'f':
+        floatInputs = true;
+        break;
+      case 'k':
+        carryChains = true;
+        break;
+      case 'm':
+        useMPFR = true;
+        break;
+      case 'l':
+        useMPFR = false;
+        break;
+      case 's':
+        signs = true;
+        break;
+      case 'e':
+        edgeCases = true;
+        break;
+      case 'b':
+        batchRows = atoi(optarg);
+        break;
+      case 'r':
+        timedTests = atoi(optarg);
+        break;
+      case 'j':
+        numThreads = atoi(optarg);
+        break;
+    }
+  } while(ret != -1);
+}
+
+int main(int argc, char **argv) {
+  int testSize = 1024;
+  int numTests = 65536;
+  typedef double fptype;
+  bool sweep = false;
+  bool floatInputs = false;
+  bool carryChains = false;
+  bool useMPFR = true;
+  bool signs = false;
+  bool edgeCases = false;
+  int batchRows = 0;
+  /* -r: the tests timed, all by default so the times are
+   * totals over every test; -j: the threads for the rest */
+  int timedTests = -1;
+  unsigned numThreads = std::thread::hardware_concurrency();
+  parseOptions(argc, argv, testSize, numTests, sweep,
+               floatInputs, carryChains, useMPFR, signs,
+               edgeCases, batchRows, timedTests,
+               numThreads);
+  if(numThreads == 0) numThreads = 1;
+  if(timedTests < 0) timedTests = numTests;
+  if(sweep) {
+    unrollSweep<fptype>(testSize, numTests);
+    return 0;
+  }
+  if(carryChains) {
+    carryChainBenchmark<fptype>(testSize, numTests);
+    return 0;
+  }
+  if(edgeCases) {
+    edgeCaseCheck<fptype>();
+    return 0;
+  }
+  if(signs) {
+    signPredicateBenchmark<fptype>(testSize, numTests);
+    return 0;
+  }
+  if(batchRows > 0) {
+    batchBenchmark<fptype>(testSize, numTests, batchRows);
+    return 0;
+  }
+
+  /* Every kernel goes through dispatchKernel,
+   * which picks the build for this CPU's ISA */
+  const dotProdKernel<fptype> kernels[] = {
+    { "Naive",
+      dispatchKernel<fptype, fptype, dotProd<fptype> >() },
+    { "Compensated",
+      dispatchKernel<fptype, fptype,
+                     compensatedDotProd<fptype> >() },
+    { "SIMD Compensated",
+      dispatchKernel<fptype, fptype,
+                     simdCompensatedDotProd<fptype> >() },
+    { "Dot3",
+      dispatchKernel<fptype, fptype, dotK<fptype, 3> >() },
+    { "Dot4",
+      dispatchKernel<fptype, fptype, dotK<fptype, 4> >() },
+    { "Kahan",
+      dispatchKernel<fptype, fptype,
+                     kahanDotProd<fptype> >() },
+    { "SIMD Kahan",
+      dispatchKernel<fptype, fptype,
+                     simdKahanDotProd<fptype> >() },
+    { "FMA", dispatchKernel<fptype, fptype,
+                            fmaDotProd<fptype> >() },
+    { "Unrolled Naive",
+      dispatchKernel<fptype, fptype,
+                     dotProdN<fptype> >() },
+    { "Unrolled FMA",
+      dispatchKernel<fptype, fptype,
+                     fmaDotProdN<fptype> >() },
+    { "Double-Double",
+      dispatchKernel<
+          fptype, fptype,
+          roundedResult<fptype, ddReal<fptype>,
+                        simdDDDotProd<fptype> > >() },
+    { "Quad-Double",
+      dispatchKernel<
+          fptype, fptype,
+          roundedResult<fptype, qdReal<fptype>,
+                        extendedDotProd<
+                            fptype, qdReal<fptype> > > >() },
+    { "Kobbelt",
+      dispatchKernel<fptype, fptype,
+                     kobbeltDotProd<fptype, fptype> >() },
+    { "Parallel Kobbelt",
+      dispatchKernel<
+          fptype, fptype,
+          parallelKobbeltDotProd<fptype, fptype> >() },
+    { "Kobbelt Double-Double",
+      dispatchKernel<
+          fptype, fptype,
+          roundedResult<fptype, ddReal<fptype>,
+                        kobbeltDotProd<
+                            fptype, ddReal<fptype> > > >() },
+    { "AccDot",
+      dispatchKernel<fptype, fptype,
+                     accDotProd<fptype> >() },
+    { "Reproducible",
+      dispatchKernel<fptype, fptype,
+                     reproDotProd<fptype> >() },
+    { "SIMD Reproducible",
+      dispatchKernel<fptype, fptype,
+                     simdReproDotProd<fptype> >() },
+    { "Parallel Reproducible",
+      dispatchKernel<fptype, fptype,
+                     parallelReproDotProd<fptype> >() },
+    { "Superaccumulator",
+      dispatchKernel<fptype, fptype,
+                     superaccDotProd<fptype, fptype> >() },
+    { "Ozaki",
+      dispatchKernel<fptype, fptype,
+                     ozakiDotProd<fptype> >() },
+    { "Online Exact",
+      dispatchKernel<fptype, fptype,
+                     onlineExactDotProd<fptype, fptype> >() },
+    { "Fixed Point",
+      dispatchKernel<fptype, fptype,
+                     fixedPointDotProd<fptype> >() },
+    { "Kulisch",
+      dispatchKernel<fptype, fptype,
+                     kulischDotProd<fptype, fptype> >() }
+  };
+  /* -f: float data, with the results compared in double */
+  const dotProdKernel<float, double> floatKernels[] = {
+    { "Float Naive",
+      dispatchKernel<
+          float, double,
+          resultAs<float, double, dotProd<float> > >() },
+    { "Float FMA",
+      dispatchKernel<
+          float, double,
+          resultAs<float, double, fmaDotProd<float> > >() },
+    { "Float SIMD Compensated",
+      dispatchKernel<float, double,
+                     resultAs<float, double,
+                              simdCompensatedDotProd<
+                                  float> > >() },
+    { "Widened Double",
+      dispatchKernel<float, double,
+                     widenedDotProd<float, double> >() },
+    { "Widened Double-Double",
+      dispatchKernel<float, double,
+                     widenedDDDotProd<float, double> >() },
+    { "Float Reproducible",
+      dispatchKernel<float, double,
+                     simdReproDotProd<float, double> >() },
+    { "Float Fixed Point",
+      dispatchKernel<float, double,
+                     fixedPointDotProd<float, double> >() }
+  };
+  if(floatInputs) {
+    runBenchmark(floatKernels,
+                 sizeof(floatKernels) / sizeof(floatKernels[0]),
+                 testSize, numTests, timedTests, numThreads,
+                 makeOracle<float>(useMPFR));
+  } else {
+    runBenchmark(kernels, sizeof(kernels) / sizeof(kernels[0]),
+                 testSize, numTests, timedTests, numThreads,
+                 makeOracle<fptype>(useMPFR));
+  }
   return 0;
 }
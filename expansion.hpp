@@ -0,0 +1,155 @@
+#ifndef _EXPANSION_HPP_
+#define _EXPANSION_HPP_
+
+#include <array>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "accurate_math.hpp"
+#include "simd.hpp"
+
+/* Shewchuk's floating point expansions and an adaptive
+ * sign predicate for dot products, after "Adaptive
+ * Precision Floating-Point Arithmetic and Fast Robust
+ * Geometric Predicates".
+ *
+ * An expansion is a vector of nonoverlapping fptypes in
+ * increasing order of magnitude whose exact sum is the
+ * value represented, so its sign is the sign of the last
+ * component. Zero components are dropped as they appear.
+ * Like the rest of the error free transforms this
+ * requires round to nearest and no overflow or underflow.
+ */
+
+/* Adds b to the expansion e exactly */
+template <typename fptype>
+void growExpansion(std::vector<fptype> &e, fptype b) {
+  fptype q = b;
+  unsigned len = 0;
+  for(unsigned i = 0; i < e.size(); i++) {
+    std::array<fptype, 2> sum = twoSum(q, e[i]);
+    q = sum[0];
+    if(sum[1] != 0.0) e[len++] = sum[1];
+  }
+  e.resize(len);
+  if(q != 0.0 || len == 0) e.push_back(q);
+}
+
+/* An approximation of the value of e */
+template <typename fptype>
+fptype expansionEstimate(const std::vector<fptype> &e) {
+  fptype ret = 0.0;
+  for(unsigned i = 0; i < e.size(); i++) ret += e[i];
+  return ret;
+}
+
+template <typename fptype>
+int expansionSign(const std::vector<fptype> &e) {
+  fptype top = e.empty() ? 0.0 : e.back();
+  return (top > 0.0) - (top < 0.0);
+}
+
+/* The exact dot product as an expansion */
+template <typename fptype>
+std::vector<fptype> dotProdExpansion(const fptype *v1,
+                                     const fptype *v2,
+                                     unsigned len) {
+  std::vector<fptype> e;
+  for(unsigned i = 0; i < len; i++) {
+    std::array<fptype, 2> prod = twoProd(v1[i], v2[i]);
+    growExpansion(e, prod[1]);
+    growExpansion(e, prod[0]);
+  }
+  return e;
+}
+
+/* The stages of adaptiveDotSign, cheapest first */
+enum dotSignStage { dotSignFMA, dotSignDot2, dotSignExact };
+
+inline const char *dotSignStageName(dotSignStage stage) {
+  switch(stage) {
+    case dotSignFMA:
+      return "FMA";
+    case dotSignDot2:
+      return "Dot2";
+    default:
+      return "Exact";
+  }
+}
+
+struct dotSignResult {
+  int sign;
+  dotSignStage stage;
+};
+
+/* k u / (1 - k u), the usual bound on k roundings */
+template <typename fptype>
+fptype errorGamma(unsigned k) {
+  const fptype u = std::ldexp(
+      fptype(1.0), -std::numeric_limits<fptype>::digits);
+  return k * u / (1 - k * u);
+}
+
+/* The sign of the dot product of v1 and v2, computed only
+ * as accurately as needed to be certain of it.
+ *
+ * The first stage is the FMA dot product s together with
+ * T = sum |v1[i] v2[i]|, also by FMA, in one pass. In any
+ * order the error of s is at most gamma(len) times the
+ * exact sum of |v1[i] v2[i]|, which is at most
+ * T / (1 - gamma(len)), so if |s| exceeds gamma(2 len) T
+ * the sign of s is right. Otherwise Dot2 is computed,
+ * whose error is at most u |x| + gamma(len)^2 times the
+ * same sum, which certifies a sign when the result
+ * exceeds a little more than the second term. The lane
+ * merges in simdCompensatedDotProd add a few terms, so
+ * len is padded for them. Failing that the dot product
+ * is computed exactly as an expansion.
+ * The bounds are padded further to cover their own
+ * rounding.
+ */
+template <typename fptype,
+          unsigned lanes = simdWidest<fptype>::width>
+dotSignResult adaptiveDotSign(const fptype *v1,
+                              const fptype *v2,
+                              unsigned len) {
+  typedef simd<fptype, lanes> vec;
+  vec s(0.0);
+  vec t(0.0);
+  unsigned i = 0;
+  for(; i + lanes <= len; i += lanes) {
+    vec a = vec::load(v1 + i);
+    vec b = vec::load(v2 + i);
+    s = fma(a, b, s);
+    t = fma(fabs(a), fabs(b), t);
+  }
+  fptype dot = s.reduceAdd();
+  fptype magnitude = t.reduceAdd();
+  for(; i < len; i++) {
+    dot = std::fma(v1[i], v2[i], dot);
+    magnitude =
+        std::fma(std::fabs(v1[i]), std::fabs(v2[i]), magnitude);
+  }
+  dotSignResult ret;
+  const fptype boundFMA =
+      errorGamma<fptype>(2 * len + 4) * magnitude;
+  if(std::fabs(dot) > boundFMA) {
+    ret.sign = (dot > 0.0) - (dot < 0.0);
+    ret.stage = dotSignFMA;
+    return ret;
+  }
+  dot = simdCompensatedDotProd<fptype>(v1, v2, len);
+  const fptype gammaDot2 = errorGamma<fptype>(2 * len + 256);
+  const fptype boundDot2 = gammaDot2 * gammaDot2 * magnitude;
+  if(std::fabs(dot) > boundDot2) {
+    ret.sign = (dot > 0.0) - (dot < 0.0);
+    ret.stage = dotSignDot2;
+    return ret;
+  }
+  ret.sign = expansionSign(dotProdExpansion(v1, v2, len));
+  ret.stage = dotSignExact;
+  return ret;
+}
+
+#endif
@@ -0,0 +1,252 @@
+#ifndef _FIXED_POINT_HPP_
+#define _FIXED_POINT_HPP_
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <string.h>
+
+#include "genericfp.hpp"
+#include "kulisch.hpp"
+#include "simd.hpp"
+
+/* An exact dot product for vectors whose exponents span a
+ * bounded range, as for data drawn from a fixed magnitude
+ * interval.
+ *
+ * A first SIMD pass finds the range of the exponents of
+ * the nonzero entries of each vector. Every product is
+ * then its integer mantissa product times 2^s, for a shift
+ * s between 0 and the spread of the exponent sums, so the
+ * dot product is a 192 bit integer times a common power of
+ * two. When the spread leaves room for len products below
+ * 2^191, the second pass forms each product with one
+ * signed 64 by 64 bit multiply and adds it to a 128 bit
+ * bucket for its shift. The buckets are shifted into the
+ * 192 bit sum at the end, which is rounded correctly.
+ * Otherwise, or for infinities and NaNs, the
+ * KulischAccumulator does the work. For double and len
+ * 4096 the spread may be 73 bits.
+ */
+
+/* A signed 192 bit integer in two's complement */
+struct fixedPointSum {
+  unsigned __int128 low;
+  unsigned long long high;
+
+  /* Adds x * 2^s, for s < 128 */
+  void add(__int128 x, unsigned s) {
+    unsigned __int128 partLow = (unsigned __int128)x << s;
+    /* Split so the shift is at most 127 when s is 0 */
+    unsigned long long partHigh =
+        (unsigned long long)((x >> (127 - s)) >> 1);
+    low += partLow;
+    high += partHigh + (low < partLow);
+  }
+
+  /* The value times 2^exp, correctly rounded to nearest
+   * even */
+  template <typename rettype>
+  rettype result(int exp) const {
+    bool negative = high >> 63;
+    unsigned __int128 absLow = low;
+    unsigned long long absHigh = high;
+    if(negative) {
+      absLow = -low;
+      absHigh = ~high + (low == 0);
+    }
+    int msb;
+    if(absHigh != 0)
+      msb = 191 - __builtin_clzll(absHigh);
+    else if((unsigned long long)(absLow >> 64) != 0)
+      msb = 127 - __builtin_clzll(
+                      (unsigned long long)(absLow >> 64));
+    else if((unsigned long long)absLow != 0)
+      msb = 63 -
+            __builtin_clzll((unsigned long long)absLow);
+    else
+      return 0.0;
+    /* The lowest bit kept, limited by the precision of
+     * rettype and by its smallest subnormal */
+    constexpr const int retDigits =
+        std::numeric_limits<rettype>::digits;
+    constexpr const int retMinExp =
+        std::numeric_limits<rettype>::min_exponent -
+        retDigits;
+    int lsb = msb - (retDigits - 1);
+    if(lsb < retMinExp - exp) lsb = retMinExp - exp;
+    if(lsb < 0) lsb = 0;
+    /* Less than half the smallest subnormal */
+    if(lsb > msb + 1) return negative ? -0.0 : 0.0;
+    unsigned long long mantissa =
+        bits(absLow, absHigh, lsb);
+    if(lsb > 0 && bits(absLow, absHigh, lsb - 1) & 1) {
+      /* Whether anything below the rounding bit is set */
+      bool sticky;
+      if(lsb - 1 >= 128)
+        sticky = absLow != 0 ||
+                 (absHigh & ((1ull << (lsb - 129)) - 1));
+      else
+        sticky =
+            (absLow & (((unsigned __int128)1 << (lsb - 1)) -
+                       1)) != 0;
+      if(sticky || (mantissa & 1)) {
+        mantissa++;
+        if(mantissa == 0) {
+          mantissa = 1ull << 63;
+          lsb++;
+        }
+      }
+    }
+    rettype ret = std::ldexp((rettype)mantissa, lsb + exp);
+    return negative ? -ret : ret;
+  }
+
+ private:
+  /* The 64 bits starting at bit pos */
+  static unsigned long long bits(unsigned __int128 absLow,
+                                 unsigned long long absHigh,
+                                 int pos) {
+    if(pos >= 192) return 0;
+    if(pos >= 128) return absHigh >> (pos - 128);
+    unsigned long long ret =
+        (unsigned long long)(absLow >> pos);
+    if(pos > 64) ret |= absHigh << (128 - pos);
+    return ret;
+  }
+};
+
+/* Signed integers the size of fptype */
+template <typename fptype>
+struct fixedPointBits;
+
+template <>
+struct fixedPointBits<float> {
+  typedef int type;
+};
+
+template <>
+struct fixedPointBits<double> {
+  typedef long long type;
+};
+
+/* The smallest and largest biased exponents of the nonzero
+ * entries of x, with subnormals given that of the smallest
+ * normal number. False if x has infinities or NaNs, and
+ * minExp is left above maxExp if x is all zero.
+ * The magnitudes' bit patterns are ordered like their
+ * values, and less one, masked again, they put zero last,
+ * so integer lanes find both with packed min and max */
+template <typename fptype,
+          unsigned lanes = simdWidest<fptype>::width>
+bool exponentRange(const fptype *x, unsigned len,
+                   unsigned &minExp, unsigned &maxExp) {
+  typedef fpconvert<fptype> fields;
+  typedef typename fixedPointBits<fptype>::type bitsType;
+  typedef simd<bitsType, lanes> vec;
+  const bitsType magnitudeMask =
+      std::numeric_limits<bitsType>::max();
+  const vec maskPack(magnitudeMask);
+  const vec one(1);
+  vec lo(magnitudeMask);
+  vec hi(0);
+  unsigned i = 0;
+  for(; i + lanes <= len; i += lanes) {
+    vec m = vec::load((const bitsType *)(x + i)) & maskPack;
+    lo = min((m - one) & maskPack, lo);
+    hi = max(m, hi);
+  }
+  bitsType smallest = lo.reduceMin();
+  bitsType largest = hi.reduceMax();
+  for(; i < len; i++) {
+    bitsType m;
+    memcpy(&m, x + i, sizeof(m));
+    m &= magnitudeMask;
+    bitsType key = (m - 1) & magnitudeMask;
+    smallest = key < smallest ? key : smallest;
+    largest = m > largest ? m : largest;
+  }
+  maxExp = largest >> fields::pBits;
+  if(maxExp == (1u << fields::eBits) - 1) return false;
+  if(smallest == magnitudeMask) {
+    minExp = 1;
+    maxExp = 0;
+    return true;
+  }
+  minExp = (smallest + 1) >> fields::pBits;
+  if(minExp == 0) minExp = 1;
+  if(maxExp == 0) maxExp = 1;
+  return true;
+}
+
+template <typename fptype, typename rettype = fptype,
+          unsigned lanes = simdWidest<fptype>::width>
+rettype fixedPointDotProd(const fptype *v1,
+                          const fptype *v2,
+                          unsigned len) {
+  typedef fpconvert<fptype> fields;
+  constexpr const int bias = (1 << (fields::eBits - 1)) - 1;
+  unsigned min1, max1, min2, max2;
+  if(!exponentRange<fptype, lanes>(v1, len, min1, max1) ||
+     !exponentRange<fptype, lanes>(v2, len, min2, max2))
+    return kulischDotProd<fptype, rettype>(v1, v2, len);
+  /* A zero vector */
+  if(min1 > max1 || min2 > max2) return 0.0;
+  int countBits = 0;
+  while((1ull << countBits) < len) countBits++;
+  /* The sum must stay below 2^191, and shifts below 128 */
+  const int maxShift =
+      std::min(191 - 2 * (int)fields::precision - countBits,
+               127);
+  if((int)(max1 + max2 - min1 - min2) > maxShift)
+    return kulischDotProd<fptype, rettype>(v1, v2, len);
+  const unsigned minSum = min1 + min2;
+  const unsigned spread = max1 + max2 - minSum;
+  /* Products of one exponent sum are added up as 128 bit
+   * integers, blockSize of which can't overflow */
+  constexpr const int blockBits =
+      126 - 2 * (int)fields::precision;
+  constexpr const unsigned blockSize =
+      1u << (blockBits < 30 ? blockBits : 30);
+  __int128 buckets[128];
+  fixedPointSum total = { 0, 0 };
+  unsigned end;
+  for(unsigned begin = 0; begin < len; begin = end) {
+    end = std::min(len - begin, blockSize) + begin;
+    memset(buckets, 0, sizeof(buckets[0]) * (spread + 1));
+    for(unsigned i = begin; i < end; i++) {
+      fields f1 = gfFPStruct(v1[i]);
+      fields f2 = gfFPStruct(v2[i]);
+      if(f1.exponent == 0 || f2.exponent == 0) {
+        /* Zeros and subnormals, which are rare */
+        if(v1[i] == 0.0 || v2[i] == 0.0) continue;
+      }
+      unsigned long long m1 = f1.mantissa;
+      unsigned long long m2 = f2.mantissa;
+      unsigned e1 = f1.exponent;
+      unsigned e2 = f2.exponent;
+      if(e1 == 0)
+        e1 = 1;
+      else
+        m1 |= 1ull << fields::pBits;
+      if(e2 == 0)
+        e2 = 1;
+      else
+        m2 |= 1ull << fields::pBits;
+      /* The sign is applied to m1 without a branch, as it
+       * is unpredictable, so one signed multiply gives the
+       * product */
+      long long negative = -(long long)(f1.sign ^ f2.sign);
+      long long signedM1 =
+          ((long long)m1 ^ negative) - negative;
+      buckets[e1 + e2 - minSum] +=
+          (__int128)signedM1 * (long long)m2;
+    }
+    for(unsigned k = 0; k <= spread; k++)
+      total.add(buckets[k], k);
+  }
+  return total.template result<rettype>(
+      (int)minSum - 2 * (bias + (int)fields::pBits));
+}
+
+#endif
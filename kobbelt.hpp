@@ -3,11 +3,14 @@
 #define _KOBBELT_HPP_
 
 #include <cmath>
-#include <map>
+#include <algorithm>
 #include <array>
+#include <vector>
+#include <string.h>
 
 #include "accurate_math.hpp"
 #include "genericfp.hpp"
+#include "thread_pool.hpp"
 
 template <typename T>
 constexpr int sign(const T &val) {
@@ -21,65 +24,263 @@ int computeGenus(fptype val) {
          (hwFloatFields.mantissa & 1);
 }
 
+/* The partial sums indexed by genus, in a flat array with
+ * one slot per possible genus (4096 for double) and a
+ * bitmap recording which slots are occupied, so lookups,
+ * inserts and erases are a single indexed access and
+ * never allocate. Only the bitmap is initialized.
+ * A second level bitmap marks the bitmap words which have
+ * been written since the last clear, so clearing and
+ * walking the table only touch the words in use.
+ */
 template <typename fptype>
-void tableInsert(std::map<int, fptype> &table, fptype val) {
-  /* First determine where in the table the value is to go */
-  int genus = computeGenus(val);
-  if(table.count(genus) == 0) {
-    /* There is no value here
-     * We might be able to exactly add this number
-     * and the one with the same exponent
-     * but different final bit in the mantissa,
-     * though, so check for that one.
-     * If it exists and is of opposite sign,
-     * then it will work
-     */
-    int otherGenus = genus ^ 1;
-    if(table.count(otherGenus) > 0 &&
-       sign(val) != sign(table[otherGenus])) {
-      /* The other value exists and is of the correct sign,
-       * so add them together, remove the other value,
-       * and insert their sum
+struct genusTable {
+  static const unsigned numGenera =
+      2u << fpconvert<fptype>::eBits;
+  static const unsigned wordBits = 64;
+  static const unsigned numWords = numGenera / wordBits;
+  static const unsigned numTouchedWords =
+      (numWords + wordBits - 1) / wordBits;
+
+  fptype slots[numGenera];
+  unsigned long long occupied[numWords];
+  unsigned long long touched[numTouchedWords];
+
+  genusTable() {
+    memset(occupied, 0, sizeof(occupied));
+    memset(touched, 0, sizeof(touched));
+  }
+
+  /* Calls f(w) for each bitmap word w which may be
+   * nonzero, in increasing order */
+  template <typename func>
+  void forEachTouched(func f) const {
+    for(unsigned t = 0; t < numTouchedWords; t++) {
+      unsigned long long bits = touched[t];
+      while(bits != 0) {
+        f(t * wordBits + __builtin_ctzll(bits));
+        bits &= bits - 1;
+      }
+    }
+  }
+
+  void clear() {
+    forEachTouched([this](unsigned w) { occupied[w] = 0; });
+    memset(touched, 0, sizeof(touched));
+  }
+
+  int count(int genus) const {
+    return (occupied[genus / wordBits] >>
+            (genus % wordBits)) &
+           1;
+  }
+
+  fptype &operator[](int genus) { return slots[genus]; }
+
+  void insert(int genus, fptype val) {
+    unsigned w = genus / wordBits;
+    slots[genus] = val;
+    occupied[w] |= 1ull << (genus % wordBits);
+    touched[w / wordBits] |= 1ull << (w % wordBits);
+  }
+
+  void erase(int genus) {
+    occupied[genus / wordBits] &=
+        ~(1ull << (genus % wordBits));
+  }
+
+  /* Erases the slot, returning what was in it */
+  fptype take(int genus) {
+    erase(genus);
+    return slots[genus];
+  }
+
+  /* The occupancy of genus and of the genus with the same
+   * exponent and opposite final mantissa bit, as two bits
+   * indexed by the final mantissa bit */
+  unsigned pairOccupancy(int genus) const {
+    return (occupied[genus / wordBits] >>
+            ((genus & ~1) % wordBits)) &
+           3;
+  }
+
+  /* Calls f(genus, value) for each occupied slot,
+   * from least genus to greatest */
+  template <typename func>
+  void forEach(func f) const {
+    forEachTouched([this, &f](unsigned w) {
+      unsigned long long bits = occupied[w];
+      while(bits != 0) {
+        unsigned genus = w * wordBits + __builtin_ctzll(bits);
+        f(genus, slots[genus]);
+        bits &= bits - 1;
+      }
+    });
+  }
+
+  /* Adds the occupied slots together in rettype,
+   * from least genus to greatest */
+  template <typename rettype>
+  rettype sum() const {
+    rettype ret = 0.0;
+    forEach([&ret](unsigned, fptype val) { ret += val; });
+    return ret;
+  }
+};
+
+/* Inserts val into the table, merging it with any entry
+ * it can be added to exactly and carrying the sum on
+ * until it reaches a free slot.
+ * Returns the number of merges, i.e. the length of the
+ * carry chain.
+ */
+template <typename fptype>
+unsigned tableInsert(genusTable<fptype> &table, fptype val) {
+  unsigned carries = 0;
+  for(;;) {
+    /* First determine where in the table the value is to go */
+    int genus = computeGenus(val);
+    unsigned pair = table.pairOccupancy(genus);
+    int mate;
+    if(pair & (1u << (genus & 1))) {
+      /* There is already a value of the same genus,
+       * so we can add them exactly
        */
-      val += table[otherGenus];
-      table.erase(otherGenus);
-      tableInsert(table, val);
+      mate = genus;
+    } else if(pair != 0 &&
+              sign(val) != sign(table[genus ^ 1])) {
+      /* The value with the same exponent but different
+       * final bit in the mantissa exists and is of
+       * opposite sign, so they can also be added exactly
+       */
+      mate = genus ^ 1;
     } else {
       /* Nothing else to do, just insert it */
-      table.insert({genus, val});
+      table.insert(genus, val);
+      return carries;
     }
-  } else {
-    /* There is already a value of the same genus,
-     * so we can add them exactly,
-     * remove the other value from the table,
-     * and then insert their sum
-     */
-    val += table[genus];
-    table.erase(genus);
-    tableInsert(table, val);
+    /* Remove the other value and carry their sum on */
+    val += table.take(mate);
+    carries++;
   }
 }
 
+/* Exactly adds the values in src to dest */
+template <typename fptype>
+void tableMerge(genusTable<fptype> &dest,
+                const genusTable<fptype> &src) {
+  src.forEach([&dest](unsigned, fptype val) {
+    tableInsert(dest, val);
+  });
+}
+
+/* Inserts the exact products of v1[i] and v2[i]
+ * for begin <= i < end */
+template <typename fptype>
+void tableInsertProducts(genusTable<fptype> &table,
+                         const fptype *v1, const fptype *v2,
+                         unsigned begin, unsigned end) {
+  for(unsigned i = begin; i < end; i++) {
+    std::array<fptype, 2> prod = twoProd(v1[i], v2[i]);
+    tableInsert(table, prod[0]);
+    tableInsert(table, prod[1]);
+  }
+}
+
+/* A Kobbelt dot product which can be reused across many
+ * short vectors without building a table each time;
+ * reset() only touches the parts of the table in use.
+ */
+template <typename fptype>
+class KobbeltAccumulator {
+ public:
+  /* Adds the exact product x * y */
+  void add(fptype x, fptype y) {
+    std::array<fptype, 2> prod = twoProd(x, y);
+    tableInsert(table, prod[0]);
+    tableInsert(table, prod[1]);
+  }
+
+  void addProducts(const fptype *v1, const fptype *v2,
+                   unsigned n) {
+    tableInsertProducts(table, v1, v2, 0, n);
+  }
+
+  /* The sum so far, leaving the accumulator unchanged */
+  template <typename rettype>
+  rettype result() const {
+    return table.template sum<rettype>();
+  }
+
+  void reset() { table.clear(); }
+
+ private:
+  genusTable<fptype> table;
+};
+
+/* Long vectors are cut into blocks of this many elements.
+ * Each block is inserted into its own table, and the block
+ * tables are merged into the first in block order. The
+ * blocks don't depend on the number of threads, so the
+ * serial and parallel versions build the same table and
+ * return identical results.
+ */
+constexpr const unsigned kobbeltBlockSize = 1 << 16;
+
 template <typename fptype, typename rettype>
 rettype kobbeltDotProd(const fptype *v1, const fptype *v2,
                        const unsigned int size) {
   /* Start by inserting the exact products
    * of the values into a table ordered by their genus
    */
-  std::map<int, fptype> table;
-  for(unsigned int i = 0; i < size; i++) {
-    std::array<fptype, 2> prod = twoProd(v1[i], v2[i]);
-    tableInsert(table, prod[0]);
-    tableInsert(table, prod[1]);
+  genusTable<fptype> table;
+  tableInsertProducts(table, v1, v2, 0,
+                      std::min(size, kobbeltBlockSize));
+  if(size > kobbeltBlockSize) {
+    genusTable<fptype> block;
+    for(unsigned i = kobbeltBlockSize; i < size;
+        i += kobbeltBlockSize) {
+      block.clear();
+      tableInsertProducts(
+          block, v1, v2, i,
+          std::min(size - i, kobbeltBlockSize) + i);
+      tableMerge(table, block);
+    }
   }
   /* Now add them together in the order
    * from least genus to greatest
    */
-  rettype ret = 0.0;
-  for(auto kvpair : table) {
-    ret += kvpair.second;
-  }
-  return ret;
+  return table.template sum<rettype>();
+}
+
+/* kobbeltDotProd with the blocks filled in parallel on
+ * pool, each into a private table, before being merged in
+ * order on the calling thread */
+template <typename fptype, typename rettype>
+rettype parallelKobbeltDotProd(const fptype *v1,
+                               const fptype *v2,
+                               const unsigned int size,
+                               threadPool &pool) {
+  const unsigned numBlocks =
+      size == 0 ? 1 : (size - 1) / kobbeltBlockSize + 1;
+  std::vector<genusTable<fptype> > tables(numBlocks);
+  pool.run(numBlocks, [&](unsigned block) {
+    unsigned begin = block * kobbeltBlockSize;
+    unsigned end = std::min(size - begin, kobbeltBlockSize) +
+                   begin;
+    tableInsertProducts(tables[block], v1, v2, begin, end);
+  });
+  for(unsigned i = 1; i < numBlocks; i++)
+    tableMerge(tables[0], tables[i]);
+  return tables[0].template sum<rettype>();
+}
+
+template <typename fptype, typename rettype>
+rettype parallelKobbeltDotProd(const fptype *v1,
+                               const fptype *v2,
+                               const unsigned int size) {
+  return parallelKobbeltDotProd<fptype, rettype>(
+      v1, v2, size, defaultThreadPool());
 }
 
 #endif
@@ -0,0 +1,233 @@
+#ifndef _KULISCH_HPP_
+#define _KULISCH_HPP_
+
+#include <cmath>
+#include <limits>
+#include <string.h>
+
+#include "genericfp.hpp"
+
+/* Kulisch's long accumulator: a fixed point number wide
+ * enough to hold any product of two finite fptypes
+ * exactly, plus 64 bits of headroom for their sum, which
+ * is about 4300 bits for double.
+ *
+ * Products are formed exactly by multiplying the integer
+ * mantissas taken from the genericfp fields, shifted to
+ * their exponent and added into 32 bit digits held in
+ * 64 bit signed words. The upper half of each word
+ * absorbs carries, so an add touches a handful of digits
+ * and never propagates a carry; carries are only resolved
+ * every normalizeInterval adds and when reading the
+ * result, which is rounded correctly to any rettype.
+ *
+ * Supports float and double, whose mantissa product fits
+ * in 128 bits.
+ */
+template <typename fptype>
+class KulischAccumulator {
+ public:
+  typedef fpconvert<fptype> fields;
+
+  static const int bias = (1 << (fields::eBits - 1)) - 1;
+  /* Every product is a multiple of 2^minProdExp, which is
+   * the weight of bit 0 of the accumulator */
+  static const int minProdExp =
+      2 * (1 - bias - (int)fields::pBits);
+  static const unsigned digitBits = 32;
+  static const unsigned numBits =
+      2 * ((1 << fields::eBits) - 2) +
+      2 * fields::precision + 64;
+  static const unsigned numDigits = numBits / digitBits + 2;
+  /* Digits of the mantissa product */
+  static const unsigned prodDigits =
+      (2 * fields::precision + digitBits - 1) / digitBits;
+  /* Each add puts less than 2^33 into a word, so this many
+   * are safe before the carries must be resolved */
+  static const unsigned normalizeInterval = 1u << 29;
+
+  KulischAccumulator() { reset(); }
+
+  void reset() {
+    memset(digits, 0, sizeof(digits));
+    pending = 0;
+    nonFinite = 0.0;
+    hasNonFinite = false;
+  }
+
+  /* Adds the exact product x * y */
+  void add(fptype x, fptype y) {
+    fields fx = gfFPStruct(x);
+    fields fy = gfFPStruct(y);
+    if(gfExpAllSet(fx) || gfExpAllSet(fy)) {
+      /* Infinities and NaNs follow IEEE arithmetic */
+      nonFinite += x * y;
+      hasNonFinite = true;
+      return;
+    }
+    unsigned long long m1 = fx.mantissa;
+    unsigned long long m2 = fy.mantissa;
+    int e1 = fx.exponent;
+    int e2 = fy.exponent;
+    /* Restore the implicit bit; subnormals share the
+     * exponent of the smallest normal number */
+    if(e1 == 0)
+      e1 = 1;
+    else
+      m1 |= 1ull << fields::pBits;
+    if(e2 == 0)
+      e2 = 1;
+    else
+      m2 |= 1ull << fields::pBits;
+    unsigned __int128 prod = (unsigned __int128)m1 * m2;
+    unsigned pos = e1 + e2 - 2;
+    unsigned d = pos / digitBits;
+    unsigned r = pos % digitBits;
+    long long sign = 1 - 2 * (long long)(fx.sign ^ fy.sign);
+    for(unsigned k = 0; k < prodDigits; k++) {
+      unsigned long long chunk =
+          (unsigned long long)(prod >> (digitBits * k)) &
+          digitMask;
+      unsigned long long shifted = chunk << r;
+      digits[d + k] += sign * (long long)(shifted & digitMask);
+      digits[d + k + 1] +=
+          sign * (long long)(shifted >> digitBits);
+    }
+    if(++pending == normalizeInterval) normalize();
+  }
+
+  /* Adds x exactly */
+  void add(fptype x) {
+    fields fx = gfFPStruct(x);
+    if(gfExpAllSet(fx)) {
+      nonFinite += x;
+      hasNonFinite = true;
+      return;
+    }
+    long long m = fx.mantissa;
+    int e = fx.exponent;
+    if(e == 0)
+      e = 1;
+    else
+      m |= 1ll << fields::pBits;
+    addInteger(fx.sign ? -m : m,
+               e - bias - (int)fields::pBits);
+  }
+
+  /* Adds m * 2^exp exactly, for any exp at or above the
+   * weight of the smallest subnormal fptype and m * 2^exp
+   * no larger than the largest fptype times 2^63 */
+  void addInteger(long long m, int exp) {
+    unsigned pos = exp - minProdExp;
+    unsigned d = pos / digitBits;
+    unsigned r = pos % digitBits;
+    long long sign = m < 0 ? -1 : 1;
+    unsigned __int128 shifted =
+        (unsigned __int128)(unsigned long long)(sign * m)
+        << r;
+    for(unsigned k = 0; k < 3; k++) {
+      digits[d + k] +=
+          sign * (long long)((unsigned long long)(
+                                 shifted >> (digitBits * k)) &
+                             digitMask);
+    }
+    if(++pending == normalizeInterval) normalize();
+  }
+
+  void addProducts(const fptype *v1, const fptype *v2,
+                   unsigned n) {
+    for(unsigned i = 0; i < n; i++) add(v1[i], v2[i]);
+  }
+
+  /* The sum so far, correctly rounded to nearest even */
+  template <typename rettype>
+  rettype result() const {
+    if(hasNonFinite) return nonFinite;
+    KulischAccumulator copy(*this);
+    copy.normalize();
+    bool negative = copy.digits[numDigits - 1] < 0;
+    if(negative) {
+      for(unsigned i = 0; i < numDigits; i++)
+        copy.digits[i] = -copy.digits[i];
+      copy.normalize();
+    }
+    int top = numDigits - 1;
+    while(top >= 0 && copy.digits[top] == 0) top--;
+    if(top < 0) return 0.0;
+    int msb = top * digitBits + 63 -
+              __builtin_clzll(copy.digits[top]);
+    /* The lowest bit kept, limited by the precision of
+     * rettype and by its smallest subnormal */
+    constexpr const int retDigits =
+        std::numeric_limits<rettype>::digits;
+    constexpr const int retMinExp =
+        std::numeric_limits<rettype>::min_exponent -
+        retDigits;
+    int lsb = msb - (retDigits - 1);
+    if(lsb < retMinExp - minProdExp)
+      lsb = retMinExp - minProdExp;
+    if(lsb < 0) lsb = 0;
+    unsigned long long mantissa = 0;
+    for(int i = msb; i >= lsb; i--)
+      mantissa = (mantissa << 1) | copy.bit(i);
+    if(lsb > 0 && copy.bit(lsb - 1) &&
+       (copy.anyBelow(lsb - 1) || (mantissa & 1))) {
+      mantissa++;
+      if(mantissa == 0) {
+        /* Carried out of all 64 bits */
+        mantissa = 1ull << 63;
+        lsb++;
+      }
+    }
+    rettype ret =
+        std::ldexp((rettype)mantissa, lsb + minProdExp);
+    return negative ? -ret : ret;
+  }
+
+ private:
+  static const long long digitMask =
+      (1ll << digitBits) - 1;
+
+  /* Resolves the carries, leaving every digit but the
+   * last in [0, 2^32) */
+  void normalize() {
+    for(unsigned i = 0; i < numDigits - 1; i++) {
+      long long carry = digits[i] >> digitBits;
+      digits[i] &= digitMask;
+      digits[i + 1] += carry;
+    }
+    pending = 0;
+  }
+
+  /* These require normalized digits */
+  unsigned bit(int pos) const {
+    return (digits[pos / digitBits] >> (pos % digitBits)) &
+           1;
+  }
+
+  bool anyBelow(int pos) const {
+    int d = pos / digitBits;
+    if(digits[d] & ((1ll << (pos % digitBits)) - 1))
+      return true;
+    for(int i = 0; i < d; i++) {
+      if(digits[i] != 0) return true;
+    }
+    return false;
+  }
+
+  long long digits[numDigits];
+  unsigned pending;
+  fptype nonFinite;
+  bool hasNonFinite;
+};
+
+/* The exact dot product, rounded once to rettype */
+template <typename fptype, typename rettype = fptype>
+rettype kulischDotProd(const fptype *v1, const fptype *v2,
+                       unsigned len) {
+  KulischAccumulator<fptype> acc;
+  acc.addProducts(v1, v2, len);
+  return acc.template result<rettype>();
+}
+
+#endif
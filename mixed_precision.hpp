@@ -0,0 +1,88 @@
+#ifndef _MIXED_PRECISION_HPP_
+#define _MIXED_PRECISION_HPP_
+
+#include <array>
+
+#include "accurate_math.hpp"
+#include "simd.hpp"
+
+/* Dot products of fptype vectors (e.g. float) accumulated
+ * in a wider acctype (e.g. double), so only fptype's bytes
+ * are read from memory. The inputs are widened in
+ * registers. When acctype has at least twice fptype's
+ * precision, as double does for float, every product is
+ * exact, and the only rounding is in the accumulation.
+ */
+template <typename fptype, typename acctype = double,
+          unsigned lanes = simdWidest<acctype>::width,
+          unsigned unroll = 4>
+acctype widenedDotProd(const fptype *v1, const fptype *v2,
+                       unsigned len) {
+  typedef simd<acctype, lanes> vec;
+  constexpr const unsigned block = lanes * unroll;
+  vec total[unroll];
+  for(unsigned u = 0; u < unroll; u++) total[u] = 0.0;
+  unsigned i = 0;
+  for(; i + block <= len; i += block) {
+    for(unsigned u = 0; u < unroll; u++) {
+      vec a = vec::loadConvert(v1 + i + u * lanes);
+      vec b = vec::loadConvert(v2 + i + u * lanes);
+      total[u] += a * b;
+    }
+  }
+  acctype ret = 0.0;
+  for(; i < len; i++) ret += (acctype)v1[i] * v2[i];
+  for(unsigned u = 0; u < unroll; u++)
+    ret += total[u].reduceAdd();
+  return ret;
+}
+
+/* widenedDotProd with each lane accumulating into a
+ * double-double style (hi, lo) pair via twoSum. With exact
+ * products the only error before the final rounding is
+ * in summing the lo parts, of order n u^2 relative to the
+ * sum of |v1[i] v2[i]| for acctype's unit roundoff u,
+ * at the same memory traffic as widenedDotProd.
+ */
+template <typename fptype, typename acctype = double,
+          unsigned lanes = simdWidest<acctype>::width,
+          unsigned unroll = 4>
+acctype widenedDDDotProd(const fptype *v1,
+                         const fptype *v2, unsigned len) {
+  typedef simd<acctype, lanes> vec;
+  constexpr const unsigned block = lanes * unroll;
+  vec hi[unroll];
+  vec lo[unroll];
+  for(unsigned u = 0; u < unroll; u++) {
+    hi[u] = 0.0;
+    lo[u] = 0.0;
+  }
+  unsigned i = 0;
+  for(; i + block <= len; i += block) {
+    for(unsigned u = 0; u < unroll; u++) {
+      vec a = vec::loadConvert(v1 + i + u * lanes);
+      vec b = vec::loadConvert(v2 + i + u * lanes);
+      std::array<vec, 2> sum = twoSum(hi[u], a * b);
+      hi[u] = sum[0];
+      lo[u] += sum[1];
+    }
+  }
+  acctype sumHi = 0.0;
+  acctype sumLo = 0.0;
+  for(; i < len; i++) {
+    std::array<acctype, 2> sum =
+        twoSum(sumHi, (acctype)v1[i] * v2[i]);
+    sumHi = sum[0];
+    sumLo += sum[1];
+  }
+  for(unsigned u = 0; u < unroll; u++) {
+    for(unsigned j = 0; j < lanes; j++) {
+      std::array<acctype, 2> sum = twoSum(sumHi, hi[u][j]);
+      sumHi = sum[0];
+      sumLo += sum[1] + lo[u][j];
+    }
+  }
+  return sumHi + sumLo;
+}
+
+#endif
@@ -0,0 +1,125 @@
+#ifndef _ONLINE_SUM_HPP_
+#define _ONLINE_SUM_HPP_
+
+#include <array>
+#include <string.h>
+
+#include "accurate_math.hpp"
+#include "genericfp.hpp"
+#include "kulisch.hpp"
+
+/* Zhu and Hayes' OnlineExactSum: an exact running sum in
+ * a fixed state of two fptypes per exponent, 32KB for
+ * double, with constant work per term.
+ *
+ * A term x with exponent j is added to a1[j] with twoSum,
+ * and the rounding error goes into a2[j] with a plain
+ * add. Everything added at index j is a multiple of the
+ * ulp of exponent j, so a2[j] stays exact for as long as
+ * it takes at most 2^((precision - 1) / 2) errors, 2^26 for
+ * double. After that many terms the entries are compacted
+ * by adding them again into cleared arrays, which costs
+ * about one term per entry.
+ *
+ * result() rounds the sum of the entries correctly with a
+ * KulischAccumulator and leaves the state unchanged, so it
+ * may be called at any time.
+ */
+template <typename fptype>
+class OnlineExactSum {
+ public:
+  typedef fpconvert<fptype> fields;
+
+  static const unsigned numExponents = 1u << fields::eBits;
+  static const unsigned compactInterval =
+      1u << ((fields::precision - 1) / 2);
+
+  OnlineExactSum() { reset(); }
+
+  void reset() {
+    memset(a1, 0, sizeof(a1));
+    memset(a2, 0, sizeof(a2));
+    pending = 0;
+    nonFinite = 0.0;
+    hasNonFinite = false;
+  }
+
+  /* Adds x exactly */
+  void add(fptype x) {
+    fields f = gfFPStruct(x);
+    if(gfExpAllSet(f)) {
+      nonFinite += x;
+      hasNonFinite = true;
+      return;
+    }
+    addEntry(f.exponent, x);
+    if(++pending == compactInterval) compact();
+  }
+
+  /* Adds the product x * y, exactly so long as twoProd is,
+   * i.e. it neither overflows nor underflows */
+  void add(fptype x, fptype y) {
+    std::array<fptype, 2> prod = twoProd(x, y);
+    add(prod[0]);
+    add(prod[1]);
+  }
+
+  void addProducts(const fptype *v1, const fptype *v2,
+                   unsigned n) {
+    for(unsigned i = 0; i < n; i++) add(v1[i], v2[i]);
+  }
+
+  /* The sum so far, correctly rounded to nearest even */
+  template <typename rettype>
+  rettype result() const {
+    if(hasNonFinite) return nonFinite;
+    KulischAccumulator<fptype> total;
+    for(unsigned j = 0; j < numExponents; j++) {
+      if(a1[j] != 0.0) total.add(a1[j]);
+      if(a2[j] != 0.0) total.add(a2[j]);
+    }
+    return total.template result<rettype>();
+  }
+
+ private:
+  void addEntry(unsigned j, fptype x) {
+    std::array<fptype, 2> sum = twoSum(a1[j], x);
+    a1[j] = sum[0];
+    a2[j] += sum[1];
+  }
+
+  /* Moves the nonzero entries into cleared arrays. There
+   * are far fewer than compactInterval of them */
+  void compact() {
+    fptype values[2 * numExponents];
+    unsigned n = 0;
+    for(unsigned j = 0; j < numExponents; j++) {
+      if(a1[j] != 0.0) values[n++] = a1[j];
+      if(a2[j] != 0.0) values[n++] = a2[j];
+    }
+    memset(a1, 0, sizeof(a1));
+    memset(a2, 0, sizeof(a2));
+    for(unsigned i = 0; i < n; i++)
+      addEntry(gfFPStruct(values[i]).exponent, values[i]);
+    pending = n;
+  }
+
+  fptype a1[numExponents];
+  fptype a2[numExponents];
+  unsigned pending;
+  fptype nonFinite;
+  bool hasNonFinite;
+};
+
+/* The dot product summed with OnlineExactSum and rounded
+ * once to rettype */
+template <typename fptype, typename rettype>
+rettype onlineExactDotProd(const fptype *v1,
+                           const fptype *v2,
+                           const unsigned int size) {
+  OnlineExactSum<fptype> acc;
+  acc.addProducts(v1, v2, size);
+  return acc.template result<rettype>();
+}
+
+#endif
@@ -0,0 +1,224 @@
+#ifndef _OZAKI_HPP_
+#define _OZAKI_HPP_
+
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "accsum.hpp"
+#include "fixed_point.hpp"
+#include "genericfp.hpp"
+#include "kulisch.hpp"
+#include "simd.hpp"
+
+/* Exact dot products by Ozaki's error free splitting, for
+ * batches such as one query vector against many rows.
+ *
+ * Each vector is split into slices x = x_1 + x_2 + ...,
+ * where the entries of a slice are multiples of a common
+ * power of two with at most (digits - log2 len) / 2 bits
+ * above it. Then every product of two entries of slices
+ * fits in fptype, and so does their sum over the vector,
+ * so each slice by slice dot product is computed exactly
+ * by an ordinary SIMD loop. The exact dot product is the
+ * sum of those, which a KulischAccumulator rounds
+ * correctly. The query is split once for the whole batch.
+ *
+ * Slicing goes on until nothing is left, so the number of
+ * slices grows with the spread of exponents in a vector:
+ * about 3 for double entries of similar magnitude and
+ * length 1024. Products of slices must not underflow, and
+ * the largest entries must be some way short of overflow;
+ * pairs of vectors outside that range, or with infinities
+ * or NaNs, are left to kulischDotProd.
+ */
+
+/* Bits each slice may hold for vectors of length len */
+template <typename fptype>
+int ozakiSliceBits(unsigned len) {
+  int countBits = 0;
+  while((1ull << countBits) < len) countBits++;
+  return (std::numeric_limits<fptype>::digits - countBits) /
+         2;
+}
+
+/* The frexp exponent of the largest entries of a vector
+ * whose largest biased exponent is maxExp, as from
+ * exponentRange */
+template <typename fptype>
+int ozakiTopExponent(unsigned maxExp) {
+  typedef fpconvert<fptype> fields;
+  constexpr const int bias = (1 << (fields::eBits - 1)) - 1;
+  return (int)maxExp - bias + 1;
+}
+
+/* Whether every sigma splitting the vector is finite */
+template <typename fptype>
+bool ozakiSplits(unsigned maxExp, unsigned len) {
+  typedef std::numeric_limits<fptype> limits;
+  return ozakiTopExponent<fptype>(maxExp) + limits::digits -
+             1 - ozakiSliceBits<fptype>(len) <
+         limits::max_exponent;
+}
+
+/* Whether splitting is exact for vectors of length len
+ * whose nonzero entries have biased exponents in
+ * [min1, max1] and [min2, max2]. Both must split, and the
+ * slice dot products must not overflow, with a bit spare
+ * as slices may round up to 2^top. Every slice entry
+ * is a multiple of the lowest bit its vector may have, so
+ * the product of those mustn't be below the smallest
+ * subnormal */
+template <typename fptype>
+bool ozakiInRange(unsigned min1, unsigned max1,
+                  unsigned min2, unsigned max2,
+                  unsigned len) {
+  typedef std::numeric_limits<fptype> limits;
+  typedef fpconvert<fptype> fields;
+  constexpr const int bias = (1 << (fields::eBits - 1)) - 1;
+  /* Zero vectors have no slices */
+  if(min1 > max1 || min2 > max2) return true;
+  int countBits = 0;
+  while((1ull << countBits) < len) countBits++;
+  if(!ozakiSplits<fptype>(max1, len) ||
+     !ozakiSplits<fptype>(max2, len) ||
+     ozakiTopExponent<fptype>(max1) +
+             ozakiTopExponent<fptype>(max2) + countBits >=
+         limits::max_exponent)
+    return false;
+  const int lsb1 = (int)min1 - bias - (int)fields::pBits;
+  const int lsb2 = (int)min2 - bias - (int)fields::pBits;
+  return lsb1 + lsb2 >=
+         limits::min_exponent - limits::digits;
+}
+
+/* Splits the finite x into slices, stored one after the
+ * other in slices, and returns how many there are */
+template <typename fptype,
+          unsigned lanes = simdWidest<fptype>::width>
+unsigned ozakiSplit(const fptype *x, unsigned len,
+                    std::vector<fptype> &slices) {
+  typedef simd<fptype, lanes> vec;
+  const int bits = ozakiSliceBits<fptype>(len);
+  slices.assign(x, x + len);
+  unsigned numSlices = 0;
+  fptype mu = maxAbsVector<fptype, lanes>(x, len);
+  while(mu != 0.0) {
+    /* sigma + r stays in sigma's binade, whose ulp leaves
+     * bits bits above it for entries no larger than mu */
+    int e;
+    std::frexp(mu, &e);
+    const fptype sigma = std::ldexp(
+        fptype(1.5),
+        e + std::numeric_limits<fptype>::digits - 1 - bits);
+    slices.resize((numSlices + 2) * len);
+    fptype *r = slices.data() + numSlices * len;
+    fptype *next = r + len;
+    /* The largest remainder is found on the way */
+    const vec sigmaPack(sigma);
+    vec nextMu(0.0);
+    unsigned i = 0;
+    for(; i + lanes <= len; i += lanes) {
+      vec v = vec::load(r + i);
+      vec q = (sigmaPack + v) - sigmaPack;
+      vec rest = v - q;
+      rest.store(next + i);
+      q.store(r + i);
+      nextMu = max(fabs(rest), nextMu);
+    }
+    mu = nextMu.reduceMax();
+    for(; i < len; i++) {
+      fptype q = (sigma + r[i]) - sigma;
+      next[i] = r[i] - q;
+      r[i] = q;
+      fptype rest = std::fabs(next[i]);
+      mu = rest > mu ? rest : mu;
+    }
+    numSlices++;
+  }
+  slices.resize(numSlices * len);
+  return numSlices;
+}
+
+/* The dot product of two slices. Every partial sum is
+ * exact, so the order is free and unroll packs of lanes
+ * accumulate independently */
+template <typename fptype,
+          unsigned lanes = simdWidest<fptype>::width,
+          unsigned unroll = 4>
+fptype ozakiSliceDot(const fptype *a, const fptype *b,
+                     unsigned len) {
+  typedef simd<fptype, lanes> vec;
+  constexpr const unsigned block = lanes * unroll;
+  vec total[unroll];
+  for(unsigned u = 0; u < unroll; u++) total[u] = 0.0;
+  unsigned i = 0;
+  for(; i + block <= len; i += block) {
+    for(unsigned u = 0; u < unroll; u++)
+      total[u] += vec::load(a + i + u * lanes) *
+                  vec::load(b + i + u * lanes);
+  }
+  fptype ret = 0.0;
+  for(; i < len; i++) ret += a[i] * b[i];
+  for(unsigned u = 0; u < unroll; u++)
+    ret += total[u].reduceAdd();
+  return ret;
+}
+
+/* results[r] is the dot product of query and row r of the
+ * numRows by len row major matrix rows, correctly rounded
+ * to rettype */
+template <typename fptype, typename rettype = fptype,
+          unsigned lanes = simdWidest<fptype>::width>
+void ozakiDotProds(const fptype *query, const fptype *rows,
+                   unsigned numRows, unsigned len,
+                   rettype *results) {
+  std::vector<fptype> querySlices;
+  std::vector<fptype> rowSlices;
+  unsigned queryMin = 1, queryMax = 0;
+  const bool queryFinite = exponentRange<fptype, lanes>(
+      query, len, queryMin, queryMax);
+  /* The query is only split if some row may use it */
+  const bool querySplits =
+      queryFinite && (queryMin > queryMax ||
+                      ozakiSplits<fptype>(queryMax, len));
+  const unsigned numQuery =
+      querySplits
+          ? ozakiSplit<fptype, lanes>(query, len, querySlices)
+          : 0;
+  KulischAccumulator<fptype> acc;
+  for(unsigned r = 0; r < numRows; r++) {
+    const fptype *row = rows + (unsigned long)r * len;
+    unsigned rowMin = 1, rowMax = 0;
+    if(!querySplits ||
+       !exponentRange<fptype, lanes>(row, len, rowMin,
+                                     rowMax) ||
+       !ozakiInRange<fptype>(queryMin, queryMax, rowMin,
+                             rowMax, len)) {
+      results[r] =
+          kulischDotProd<fptype, rettype>(query, row, len);
+      continue;
+    }
+    const unsigned numRow =
+        ozakiSplit<fptype, lanes>(row, len, rowSlices);
+    acc.reset();
+    for(unsigned t = 0; t < numRow; t++) {
+      for(unsigned s = 0; s < numQuery; s++) {
+        acc.add(ozakiSliceDot<fptype, lanes>(
+            querySlices.data() + s * len,
+            rowSlices.data() + t * len, len));
+      }
+    }
+    results[r] = acc.template result<rettype>();
+  }
+}
+
+template <typename fptype, typename rettype = fptype>
+rettype ozakiDotProd(const fptype *v1, const fptype *v2,
+                     unsigned len) {
+  rettype ret;
+  ozakiDotProds(v1, v2, 1, len, &ret);
+  return ret;
+}
+
+#endif
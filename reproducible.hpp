@@ -0,0 +1,266 @@
+#ifndef _REPRODUCIBLE_HPP_
+#define _REPRODUCIBLE_HPP_
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "accurate_math.hpp"
+#include "kulisch.hpp"
+#include "simd.hpp"
+#include "thread_pool.hpp"
+
+/* Reproducible dot products by pre-rounding into bins,
+ * after Demmel and Nguyen (the algorithm behind the first
+ * ReproBLAS).
+ *
+ * A first pass finds M, the largest |v1[i] * v2[i]|.
+ * From M and the length alone, fold bins are laid out,
+ * each of width bits with bin k holding multiples of the
+ * ulp of sigma[k] = 1.5 * 2^e_k. The second pass splits
+ * every product x into fold parts, q = (sigma + x) - sigma
+ * going to each bin in turn and x - q on to the next.
+ * Both operations are exact, q depends only on x and
+ * sigma, and the bins have room for len terms, so every
+ * bin sum is exact and its value is the same whatever the
+ * order of the additions. Any split of the vectors into
+ * SIMD lanes, blocks or threads therefore gives the same
+ * bins, and the same bits once they are added together.
+ *
+ * The products are formed in acctype. When that isn't
+ * exact, as for double, the rounding error of each product
+ * from twoProd is split into the bins as well; it is too
+ * small to reach the first. The error is then that of
+ * dropping the remainders past the last bin plus the final
+ * rounding, so fold = 3 keeps about 3 * (52 - log2 len)
+ * bits below 2^e_0 for double.
+ * When len * M comes within a quarter of acctype's largest
+ * value, so sigma[0] would overflow, or a product isn't
+ * finite, kulischDotProd is used instead. Its result is
+ * correctly rounded, so it is just as reproducible.
+ */
+
+/* The largest |v1[i] * v2[i]| for begin <= i < end */
+template <typename fptype, typename acctype,
+          unsigned lanes = simdWidest<acctype>::width>
+acctype reproMaxAbs(const fptype *v1, const fptype *v2,
+                    unsigned begin, unsigned end) {
+  typedef simd<acctype, lanes> vec;
+  vec m(0.0);
+  unsigned i = begin;
+  for(; i + lanes <= end; i += lanes) {
+    vec a = vec::loadConvert(v1 + i);
+    vec b = vec::loadConvert(v2 + i);
+    m = max(fabs(a * b), m);
+  }
+  acctype ret = m.reduceMax();
+  for(; i < end; i++) {
+    acctype p = std::fabs((acctype)v1[i] * v2[i]);
+    ret = p > ret ? p : ret;
+  }
+  return ret;
+}
+
+/* Bits needed to count len terms */
+inline int reproCountBits(unsigned len) {
+  int countBits = 0;
+  while((1ull << countBits) < len) countBits++;
+  return countBits;
+}
+
+/* The exponent of sigma[0] for len terms no larger than
+ * maxAbs */
+template <typename acctype>
+int reproTopExponent(acctype maxAbs, unsigned len) {
+  int e;
+  std::frexp(maxAbs, &e);
+  return e + reproCountBits(len) + 1;
+}
+
+/* Whether the bins for len terms no larger than maxAbs
+ * are finite */
+template <typename acctype>
+bool reproFits(acctype maxAbs, unsigned len) {
+  return std::isfinite(maxAbs) &&
+         reproTopExponent(maxAbs, len) <
+             std::numeric_limits<acctype>::max_exponent;
+}
+
+/* The bin boundaries for len terms no larger than maxAbs */
+template <typename acctype, unsigned fold>
+std::array<acctype, fold> reproSigmas(acctype maxAbs,
+                                      unsigned len) {
+  typedef std::numeric_limits<acctype> limits;
+  const int width =
+      limits::digits - 1 - reproCountBits(len);
+  /* sigma's ulp may not be less than the smallest
+   * subnormal, below which every remainder is exact */
+  const int minExp = limits::min_exponent - 1;
+  int e = reproTopExponent(maxAbs, len);
+  std::array<acctype, fold> sigma;
+  for(unsigned k = 0; k < fold; k++) {
+    sigma[k] = std::ldexp(acctype(1.5), std::max(e, minExp));
+    e -= width;
+  }
+  return sigma;
+}
+
+/* Splits x into bins first and up, dropping the part
+ * below the last bin */
+template <typename T, unsigned fold>
+void reproSplit(T (&bins)[fold], const T (&sigma)[fold], T x,
+                unsigned first) {
+  for(unsigned k = first; k < fold; k++) {
+    T q = (sigma[k] + x) - sigma[k];
+    bins[k] += q;
+    x -= q;
+  }
+}
+
+/* Splits a * b, and its rounding error unless that is
+ * known to be zero, into the bins */
+template <typename fptype, typename acctype, typename T,
+          unsigned fold>
+void reproSplitProduct(T (&bins)[fold],
+                       const T (&sigma)[fold], T a, T b) {
+  constexpr const bool exactProducts =
+      std::numeric_limits<acctype>::digits >=
+      2 * std::numeric_limits<fptype>::digits;
+  if(exactProducts) {
+    reproSplit(bins, sigma, a * b, 0);
+  } else {
+    std::array<T, 2> prod = twoProd(a, b);
+    reproSplit(bins, sigma, prod[0], 0);
+    reproSplit(bins, sigma, prod[1], 1);
+  }
+}
+
+/* Splits the products of v1[i] and v2[i] for
+ * begin <= i < end into the bins */
+template <typename fptype, typename acctype, unsigned fold,
+          unsigned lanes = simdWidest<acctype>::width>
+void reproDeposit(std::array<acctype, fold> &bins,
+                  const std::array<acctype, fold> &sigma,
+                  const fptype *v1, const fptype *v2,
+                  unsigned begin, unsigned end) {
+  typedef simd<acctype, lanes> vec;
+  vec binPacks[fold];
+  vec sigmaPacks[fold];
+  acctype tail[fold];
+  acctype sigmaTail[fold];
+  for(unsigned k = 0; k < fold; k++) {
+    binPacks[k] = 0.0;
+    sigmaPacks[k] = sigma[k];
+    tail[k] = 0.0;
+    sigmaTail[k] = sigma[k];
+  }
+  unsigned i = begin;
+  for(; i + lanes <= end; i += lanes) {
+    reproSplitProduct<fptype, acctype>(
+        binPacks, sigmaPacks, vec::loadConvert(v1 + i),
+        vec::loadConvert(v2 + i));
+  }
+  for(; i < end; i++) {
+    reproSplitProduct<fptype, acctype>(
+        tail, sigmaTail, (acctype)v1[i], (acctype)v2[i]);
+  }
+  for(unsigned k = 0; k < fold; k++) {
+    bins[k] += tail[k];
+    for(unsigned j = 0; j < lanes; j++)
+      bins[k] += binPacks[k][j];
+  }
+}
+
+/* Adds the bins, smallest first. The result only depends
+ * on the bins, not how they were filled */
+template <typename acctype, unsigned fold>
+acctype reproCombine(const std::array<acctype, fold> &bins) {
+  acctype ret = bins[fold - 1];
+  for(int k = fold - 2; k >= 0; k--) ret += bins[k];
+  return ret;
+}
+
+template <typename fptype, typename acctype = fptype,
+          unsigned fold = 3,
+          unsigned lanes = simdWidest<acctype>::width>
+acctype simdReproDotProd(const fptype *v1, const fptype *v2,
+                         unsigned len) {
+  acctype maxAbs =
+      reproMaxAbs<fptype, acctype, lanes>(v1, v2, 0, len);
+  if(!reproFits(maxAbs, len))
+    return kulischDotProd<fptype, acctype>(v1, v2, len);
+  std::array<acctype, fold> sigma =
+      reproSigmas<acctype, fold>(maxAbs, len);
+  std::array<acctype, fold> bins;
+  bins.fill(0.0);
+  reproDeposit<fptype, acctype, fold, lanes>(bins, sigma, v1,
+                                             v2, 0, len);
+  return reproCombine<acctype, fold>(bins);
+}
+
+/* The scalar version, bit for bit the same as the others */
+template <typename fptype, typename acctype = fptype,
+          unsigned fold = 3>
+acctype reproDotProd(const fptype *v1, const fptype *v2,
+                     unsigned len) {
+  return simdReproDotProd<fptype, acctype, fold, 1>(v1, v2,
+                                                    len);
+}
+
+/* Both passes split into blocks run on pool. The blocks
+ * only affect the order in which the exact bin sums are
+ * formed, so this too matches the serial versions */
+constexpr const unsigned reproBlockSize = 1 << 16;
+
+template <typename fptype, typename acctype = fptype,
+          unsigned fold = 3>
+acctype parallelReproDotProd(const fptype *v1,
+                             const fptype *v2, unsigned len,
+                             threadPool &pool) {
+  const unsigned numBlocks =
+      len == 0 ? 1 : (len - 1) / reproBlockSize + 1;
+  std::vector<acctype> maxAbs(numBlocks);
+  pool.run(numBlocks, [&](unsigned block) {
+    unsigned begin = block * reproBlockSize;
+    unsigned end =
+        std::min(len - begin, reproBlockSize) + begin;
+    maxAbs[block] =
+        reproMaxAbs<fptype, acctype>(v1, v2, begin, end);
+  });
+  acctype total = 0.0;
+  for(unsigned i = 0; i < numBlocks; i++) {
+    /* Also ordered with NaNs, which are never less */
+    total = maxAbs[i] < total ? total : maxAbs[i];
+  }
+  if(!reproFits(total, len))
+    return kulischDotProd<fptype, acctype>(v1, v2, len);
+  const std::array<acctype, fold> sigma =
+      reproSigmas<acctype, fold>(total, len);
+  std::vector<std::array<acctype, fold> > bins(numBlocks);
+  pool.run(numBlocks, [&](unsigned block) {
+    unsigned begin = block * reproBlockSize;
+    unsigned end =
+        std::min(len - begin, reproBlockSize) + begin;
+    bins[block].fill(0.0);
+    reproDeposit<fptype, acctype, fold>(bins[block], sigma,
+                                        v1, v2, begin, end);
+  });
+  for(unsigned i = 1; i < numBlocks; i++) {
+    for(unsigned k = 0; k < fold; k++)
+      bins[0][k] += bins[i][k];
+  }
+  return reproCombine<acctype, fold>(bins[0]);
+}
+
+template <typename fptype, typename acctype = fptype,
+          unsigned fold = 3>
+acctype parallelReproDotProd(const fptype *v1,
+                             const fptype *v2,
+                             unsigned len) {
+  return parallelReproDotProd<fptype, acctype, fold>(
+      v1, v2, len, defaultThreadPool());
+}
+
+#endif
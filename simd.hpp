@@ -0,0 +1,169 @@
+#ifndef _SIMD_HPP_
+#define _SIMD_HPP_
+
+#include <cmath>
+#include <string.h>
+
+/* A pack of width fptype lanes, for writing a kernel once
+ * and instantiating it for float x 16, double x 8, etc.
+ *
+ * The storage is a GCC vector extension rather than an
+ * intrinsic type such as __m256d. Intrinsics are tied to
+ * the ISA the translation unit is compiled for, while the
+ * dispatch layer compiles the same template for x86-64,
+ * AVX2 and AVX-512 inside target attributed wrappers.
+ * Vector extensions lower to whatever the enclosing
+ * function's target supports: SSE2 pairs on the baseline,
+ * ymm under AVX2 and zmm under AVX-512.
+ * fma is done lane by lane with std::fma, which becomes a
+ * single packed vfmadd when FMA is available and the
+ * correctly rounded libm fma otherwise, so error free
+ * transforms stay exact on every target.
+ *
+ * Arithmetic operators and fma take and return packs,
+ * and a scalar converts to a pack by broadcasting, so the
+ * scalar templates in accurate_math.hpp also work on
+ * packs. width == 1 is the scalar fallback.
+ */
+template <typename fptype, unsigned width>
+struct simd {
+  typedef fptype vecType
+      __attribute__((vector_size(sizeof(fptype) * width)));
+  static const unsigned lanes = width;
+
+  vecType v;
+
+  simd() {}
+
+  simd(fptype x) { v = vecType{} + x; }
+
+  static simd load(const fptype *src) {
+    simd ret;
+    memcpy(&ret.v, src, sizeof(ret.v));
+    return ret;
+  }
+
+  void store(fptype *dest) const {
+    memcpy(dest, &v, sizeof(v));
+  }
+
+  /* Loads width values of srctype, converting each lane,
+   * e.g. float to double */
+  template <typename srctype>
+  static simd loadConvert(const srctype *src) {
+    simd<srctype, width> narrow =
+        simd<srctype, width>::load(src);
+    simd ret;
+    ret.v = __builtin_convertvector(narrow.v, vecType);
+    return ret;
+  }
+
+  fptype operator[](unsigned lane) const { return v[lane]; }
+
+  /* Sums the lanes in order, lane 0 first */
+  fptype reduceAdd() const {
+    fptype total = v[0];
+    for(unsigned i = 1; i < width; i++) total += v[i];
+    return total;
+  }
+
+  /* The smallest lane, in the sense of min below */
+  fptype reduceMin() const {
+    fptype ret = v[0];
+    for(unsigned i = 1; i < width; i++)
+      ret = v[i] < ret ? v[i] : ret;
+    return ret;
+  }
+
+  /* The largest lane, in the sense of max below */
+  fptype reduceMax() const {
+    fptype ret = v[0];
+    for(unsigned i = 1; i < width; i++)
+      ret = v[i] > ret ? v[i] : ret;
+    return ret;
+  }
+
+  simd &operator+=(const simd &rhs) {
+    v += rhs.v;
+    return *this;
+  }
+
+  simd &operator-=(const simd &rhs) {
+    v -= rhs.v;
+    return *this;
+  }
+
+  simd &operator*=(const simd &rhs) {
+    v *= rhs.v;
+    return *this;
+  }
+
+  /* Only for integer lanes */
+  simd &operator&=(const simd &rhs) {
+    v &= rhs.v;
+    return *this;
+  }
+
+  friend simd operator+(simd lhs, const simd &rhs) {
+    return lhs += rhs;
+  }
+
+  friend simd operator-(simd lhs, const simd &rhs) {
+    return lhs -= rhs;
+  }
+
+  friend simd operator*(simd lhs, const simd &rhs) {
+    return lhs *= rhs;
+  }
+
+  friend simd operator&(simd lhs, const simd &rhs) {
+    return lhs &= rhs;
+  }
+
+  friend simd operator-(const simd &val) {
+    simd ret;
+    ret.v = -val.v;
+    return ret;
+  }
+
+  friend simd fma(const simd &a, const simd &b,
+                  const simd &c) {
+    simd ret;
+    for(unsigned i = 0; i < width; i++)
+      ret.v[i] = std::fma(a.v[i], b.v[i], c.v[i]);
+    return ret;
+  }
+
+  /* Written as whole pack selects, since GCC leaves lane
+   * by lane loops of these scalarized. 0 - x rather than -x
+   * so that -0.0 becomes 0.0 */
+  friend simd fabs(const simd &val) {
+    simd ret;
+    ret.v = val.v <= 0 ? vecType{} - val.v : val.v;
+    return ret;
+  }
+
+  /* a > b ? a : b in each lane, a single packed max */
+  friend simd max(const simd &a, const simd &b) {
+    simd ret;
+    ret.v = a.v > b.v ? a.v : b.v;
+    return ret;
+  }
+
+  /* a < b ? a : b in each lane, a single packed min */
+  friend simd min(const simd &a, const simd &b) {
+    simd ret;
+    ret.v = a.v < b.v ? a.v : b.v;
+    return ret;
+  }
+};
+
+/* The widest pack the dispatch layer can use, one 512 bit
+ * register, which is two registers under AVX2 */
+template <typename fptype>
+struct simdWidest {
+  static const unsigned width = 64 / sizeof(fptype);
+  typedef simd<fptype, width> type;
+};
+
+#endif
@@ -0,0 +1,143 @@
+#ifndef _SUPERACCUMULATOR_HPP_
+#define _SUPERACCUMULATOR_HPP_
+
+#include <array>
+#include <string.h>
+
+#include "accurate_math.hpp"
+#include "genericfp.hpp"
+#include "kulisch.hpp"
+
+/* Neal's two level superaccumulator for exact sums.
+ *
+ * The first level has one 64 bit chunk per exponent
+ * (2048 for double). A term is added by putting its signed
+ * integer mantissa into the chunk for its exponent, which
+ * is a single integer add with no carries and no
+ * normalization. A chunk can only take so many mantissas
+ * before it may overflow, so every spillInterval terms the
+ * chunks in use are added into the second level, a
+ * KulischAccumulator, and cleared. The result is the
+ * correctly rounded exact sum.
+ *
+ * The chunks are integers rather than doubles: two
+ * doubles of the same exponent can't in general be added
+ * exactly, while their mantissas can.
+ */
+template <typename fptype>
+class SuperAccumulator {
+ public:
+  typedef fpconvert<fptype> fields;
+
+  static const int bias = (1 << (fields::eBits - 1)) - 1;
+  static const unsigned numChunks = 1u << fields::eBits;
+  static const unsigned wordBits = 64;
+  static const unsigned numWords =
+      (numChunks + wordBits - 1) / wordBits;
+  /* Each chunk holds at most this many mantissas of
+   * precision bits, which stays below 2^62 */
+  static const unsigned spillInterval =
+      fields::precision >= 42
+          ? 1u << (62 - fields::precision)
+          : 1u << 20;
+
+  SuperAccumulator() {
+    memset(chunks, 0, sizeof(chunks));
+    memset(used, 0, sizeof(used));
+    pending = 0;
+  }
+
+  /* Adds val exactly */
+  void add(fptype val) {
+    fields f = gfFPStruct(val);
+    unsigned e = f.exponent;
+    if(gfExpAllSet(f)) {
+      /* Infinities and NaNs */
+      large.add(val);
+      return;
+    }
+    long long m = f.mantissa;
+    if(e != 0) m |= 1ll << fields::pBits;
+    long long s = f.sign;
+    chunks[e] += (m ^ -s) + s;
+    used[e / wordBits] |= 1ull << (e % wordBits);
+    if(++pending == spillInterval) spill(large);
+  }
+
+  /* Adds the product x * y, exactly so long as twoProd is,
+   * i.e. it neither overflows nor underflows */
+  void add(fptype x, fptype y) {
+    std::array<fptype, 2> prod = twoProd(x, y);
+    add(prod[0]);
+    add(prod[1]);
+  }
+
+  void addProducts(const fptype *v1, const fptype *v2,
+                   unsigned n) {
+    for(unsigned i = 0; i < n; i++) add(v1[i], v2[i]);
+  }
+
+  /* The sum so far, correctly rounded to nearest even */
+  template <typename rettype>
+  rettype result() const {
+    KulischAccumulator<fptype> total(large);
+    forEachUsed([&](unsigned e) {
+      total.addInteger(chunks[e], chunkExponent(e));
+    });
+    return total.template result<rettype>();
+  }
+
+  void reset() {
+    forEachUsed([this](unsigned e) { chunks[e] = 0; });
+    memset(used, 0, sizeof(used));
+    pending = 0;
+    large.reset();
+  }
+
+ private:
+  /* The weight of the last mantissa bit of chunk e */
+  static int chunkExponent(unsigned e) {
+    return (e == 0 ? 1 : (int)e) - bias -
+           (int)fields::pBits;
+  }
+
+  /* Calls f(e) for each chunk e added to since the last
+   * spill, in increasing order */
+  template <typename func>
+  void forEachUsed(func f) const {
+    for(unsigned w = 0; w < numWords; w++) {
+      unsigned long long bits = used[w];
+      while(bits != 0) {
+        f(w * wordBits + __builtin_ctzll(bits));
+        bits &= bits - 1;
+      }
+    }
+  }
+
+  void spill(KulischAccumulator<fptype> &dest) {
+    forEachUsed([&](unsigned e) {
+      if(chunks[e] != 0)
+        dest.addInteger(chunks[e], chunkExponent(e));
+      chunks[e] = 0;
+    });
+    memset(used, 0, sizeof(used));
+    pending = 0;
+  }
+
+  long long chunks[numChunks];
+  unsigned long long used[numWords];
+  unsigned pending;
+  KulischAccumulator<fptype> large;
+};
+
+/* The dot product from the twoProd pairs, summed exactly
+ * and rounded once to rettype */
+template <typename fptype, typename rettype>
+rettype superaccDotProd(const fptype *v1, const fptype *v2,
+                        const unsigned int size) {
+  SuperAccumulator<fptype> acc;
+  acc.addProducts(v1, v2, size);
+  return acc.template result<rettype>();
+}
+
+#endif
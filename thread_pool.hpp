@@ -0,0 +1,145 @@
+#ifndef _THREAD_POOL_HPP_
+#define _THREAD_POOL_HPP_
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* A fixed set of worker threads which run batches of
+ * indexed tasks. run(n, task) calls task(i) once for each
+ * i < n, spread over the workers and the calling thread,
+ * and returns when they have all finished. Tasks are
+ * handed out in index order, but may complete in any.
+ * Batches run one at a time, so several threads may share
+ * a pool, but run is not reentrant: a task calling run on
+ * its own pool deadlocks. As defaultThreadPool is shared,
+ * a parallel kernel must not be called from the tasks of
+ * another. A batch of at most one task, or any batch on a
+ * pool of one, runs inline on the caller without touching
+ * the workers.
+ */
+class threadPool {
+ public:
+  /* numThreads counts the calling thread, so a pool of
+   * one runs everything on the caller */
+  explicit threadPool(unsigned numThreads = 0)
+      : job(NULL),
+        jobTasks(0),
+        nextTask(0),
+        busy(0),
+        generation(0),
+        stopping(false) {
+    if(numThreads == 0)
+      numThreads = std::thread::hardware_concurrency();
+    for(unsigned i = 1; i < numThreads; i++)
+      workers.push_back(std::thread(&threadPool::work, this));
+  }
+
+  ~threadPool() {
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      stopping = true;
+    }
+    wake.notify_all();
+    for(unsigned i = 0; i < workers.size(); i++)
+      workers[i].join();
+  }
+
+  unsigned size() const { return workers.size() + 1; }
+
+  void run(unsigned numTasks,
+           const std::function<void(unsigned)> &task) {
+    if(numTasks <= 1 || workers.empty()) {
+      for(unsigned i = 0; i < numTasks; i++) task(i);
+      return;
+    }
+    std::lock_guard<std::mutex> batch(runLock);
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      job = &task;
+      jobTasks = numTasks;
+      nextTask = 0;
+      busy = workers.size();
+      generation++;
+    }
+    wake.notify_all();
+    runTasks();
+    std::unique_lock<std::mutex> guard(lock);
+    while(busy > 0) done.wait(guard);
+    job = NULL;
+  }
+
+ private:
+  void runTasks() {
+    for(;;) {
+      unsigned i = nextTask++;
+      if(i >= jobTasks) return;
+      (*job)(i);
+    }
+  }
+
+  void work() {
+    unsigned long seen = 0;
+    for(;;) {
+      {
+        std::unique_lock<std::mutex> guard(lock);
+        while(!stopping && generation == seen)
+          wake.wait(guard);
+        if(stopping) return;
+        seen = generation;
+      }
+      runTasks();
+      std::lock_guard<std::mutex> guard(lock);
+      if(--busy == 0) done.notify_one();
+    }
+  }
+
+  std::vector<std::thread> workers;
+  /* Held by the thread whose batch is running */
+  std::mutex runLock;
+  std::mutex lock;
+  std::condition_variable wake;
+  std::condition_variable done;
+  const std::function<void(unsigned)> *job;
+  unsigned jobTasks;
+  std::atomic<unsigned> nextTask;
+  unsigned busy;
+  unsigned long generation;
+  bool stopping;
+};
+
+/* Makes defaultThreadPool return pool on this thread for
+ * as long as it exists, such as a pool of one for threads
+ * which are already running in parallel */
+class scopedDefaultThreadPool {
+ public:
+  explicit scopedDefaultThreadPool(threadPool &pool)
+      : previous(current()) {
+    current() = &pool;
+  }
+
+  ~scopedDefaultThreadPool() { current() = previous; }
+
+  static threadPool *&current() {
+    static thread_local threadPool *pool = NULL;
+    return pool;
+  }
+
+ private:
+  threadPool *previous;
+};
+
+/* The pool shared by the parallel kernels, with one
+ * thread per hardware thread, unless this thread has set
+ * another with scopedDefaultThreadPool */
+inline threadPool &defaultThreadPool() {
+  threadPool *scoped = scopedDefaultThreadPool::current();
+  if(scoped != NULL) return *scoped;
+  static threadPool pool;
+  return pool;
+}
+
+#endif